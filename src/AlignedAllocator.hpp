@@ -0,0 +1,99 @@
+/*
+ * AlignedAllocator.hpp
+ *
+ *	Standard allocator returning cache-line aligned memory, optionally backed by transparent huge pages
+ *	for large arrays. Huge page backing is chosen per allocator, and so per container.
+ *
+ *      Author: alexminnaar
+ */
+
+#ifndef ALIGNEDALLOCATOR_HPP_
+#define ALIGNEDALLOCATOR_HPP_
+
+#include<cstddef>
+#include<cstdlib>
+#include<new>
+#include<type_traits>
+#include <sys/mman.h>
+
+//size of a transparent huge page, allocations at least this large are aligned to it
+const std::size_t hugePageSize = 2 * 1024 * 1024;
+
+//allocator aligning every allocation to Alignment bytes (a power of two, at least sizeof(void *)). Allocators
+//constructed with hugePages advise allocations of at least hugePageSize bytes to use transparent huge pages
+template<class T, std::size_t Alignment = 64>
+class AlignedAllocator {
+
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template<class U>
+	struct rebind {
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	//containers take the huge page choice along with the memory when assigned or swapped
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	AlignedAllocator(bool hugePages = false) {
+		this->hugePages = hugePages;
+	}
+
+	template<class U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment> &other) {
+		this->hugePages = other.hugePageBacking();
+	}
+
+	//whether large allocations are advised to use transparent huge pages
+	bool hugePageBacking() const {
+		return this->hugePages;
+	}
+
+	pointer allocate(size_type count) {
+
+		const std::size_t bytes = count * sizeof(T);
+
+		//huge page backing needs the region aligned to the huge page size
+		const bool huge = this->hugePages && bytes >= hugePageSize;
+
+		void *memory = NULL;
+
+		if (posix_memalign(&memory, huge ? hugePageSize : Alignment,
+				bytes == 0 ? Alignment : bytes) != 0) {
+			throw std::bad_alloc();
+		}
+
+		if (huge) {
+			madvise(memory, bytes, MADV_HUGEPAGE);
+		}
+
+		return static_cast<pointer>(memory);
+	}
+
+	void deallocate(pointer memory, size_type) {
+		std::free(memory);
+	}
+
+	//memory from any instance is released the same way, so every instance can free it
+	bool operator==(const AlignedAllocator &) const {
+		return true;
+	}
+
+	bool operator!=(const AlignedAllocator &) const {
+		return false;
+	}
+
+private:
+
+	bool hugePages;
+};
+
+#endif /* ALIGNEDALLOCATOR_HPP_ */
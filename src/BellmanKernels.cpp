@@ -0,0 +1,678 @@
+//============================================================================
+// Name        : BellmanKernels.cpp
+// Author      : Alex Minnaar
+// Description : Scalar, AVX2 and AVX-512 Bellman backup kernels with runtime dispatch
+//============================================================================
+#include <immintrin.h>
+#include<limits>
+#include<atomic>
+#include "BellmanKernels.hpp"
+
+//number of actions whose rows are accumulated together by the fused kernels
+static const int actionGroup = 4;
+
+//---------------------------------------------------------------- scalar
+
+static double denseDotScalar(const double *a, const double *b, std::size_t n) {
+
+	double total = 0.0;
+
+	for (std::size_t j = 0; j < n; ++j) {
+		total += a[j] * b[j];
+	}
+
+	return total;
+}
+
+static double sparseDotScalar(const double *values, const int *columns,
+		std::size_t nnz, const double *x) {
+
+	double total = 0.0;
+
+	for (std::size_t k = 0; k < nnz; ++k) {
+		total += values[k] * x[columns[k]];
+	}
+
+	return total;
+}
+
+static void actionValuesScalar(const double * const *rows,
+		const double *rewards, int numActions, const double *x, std::size_t n,
+		double discount, double *values) {
+
+	for (int a = 0; a < numActions; ++a) {
+		values[a] = rewards[a] + discount * denseDotScalar(rows[a], x, n);
+	}
+}
+
+static int argmaxValueScalar(const double *values, int count, double &best) {
+
+	best = -std::numeric_limits<double>::infinity();
+	int index = 0;
+
+	//selects compile to conditional moves, only a strictly larger value moves the index
+	for (int a = 0; a < count; ++a) {
+		bool larger = values[a] > best;
+		index = larger ? a : index;
+		best = larger ? values[a] : best;
+	}
+
+	return index;
+}
+
+//---------------------------------------------------------------- AVX2
+
+__attribute__((target("avx2,fma")))
+static double horizontalSum(__m256d v) {
+
+	__m128d low = _mm256_castpd256_pd128(v);
+	__m128d high = _mm256_extractf128_pd(v, 1);
+
+	low = _mm_add_pd(low, high);
+
+	return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+__attribute__((target("avx2,fma")))
+static double denseDotAvx2(const double *a, const double *b, std::size_t n) {
+
+	//two accumulators hide the latency of the fused multiply-add
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+
+	std::size_t j = 0;
+
+	for (; j + 8 <= n; j += 8) {
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(b + j),
+				acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j + 4),
+				_mm256_loadu_pd(b + j + 4), acc1);
+	}
+
+	if (j + 4 <= n) {
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(b + j),
+				acc0);
+		j += 4;
+	}
+
+	double total = horizontalSum(_mm256_add_pd(acc0, acc1));
+
+	for (; j < n; ++j) {
+		total += a[j] * b[j];
+	}
+
+	return total;
+}
+
+__attribute__((target("avx2,fma")))
+static double sparseDotAvx2(const double *values, const int *columns,
+		std::size_t nnz, const double *x) {
+
+	__m256d acc = _mm256_setzero_pd();
+
+	std::size_t k = 0;
+
+	for (; k + 4 <= nnz; k += 4) {
+
+		//the masked gather with an explicit zero source, the plain one leaves its source undefined
+		__m128i index = _mm_loadu_si128((const __m128i *) (columns + k));
+		__m256d gathered = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x,
+				index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+
+		acc = _mm256_fmadd_pd(_mm256_loadu_pd(values + k), gathered, acc);
+	}
+
+	double total = horizontalSum(acc);
+
+	for (; k < nnz; ++k) {
+		total += values[k] * x[columns[k]];
+	}
+
+	return total;
+}
+
+__attribute__((target("avx2,fma")))
+static void actionValuesAvx2(const double * const *rows,
+		const double *rewards, int numActions, const double *x, std::size_t n,
+		double discount, double *values) {
+
+	int a = 0;
+
+	//each chunk of x is loaded once for a group of actions
+	for (; a + actionGroup <= numActions; a += actionGroup) {
+
+		__m256d acc[actionGroup];
+
+		for (int g = 0; g < actionGroup; ++g) {
+			acc[g] = _mm256_setzero_pd();
+		}
+
+		std::size_t j = 0;
+
+		for (; j + 4 <= n; j += 4) {
+
+			__m256d xv = _mm256_loadu_pd(x + j);
+
+			for (int g = 0; g < actionGroup; ++g) {
+				acc[g] = _mm256_fmadd_pd(_mm256_loadu_pd(rows[a + g] + j), xv,
+						acc[g]);
+			}
+		}
+
+		for (int g = 0; g < actionGroup; ++g) {
+
+			double dot = horizontalSum(acc[g]);
+
+			for (std::size_t r = j; r < n; ++r) {
+				dot += rows[a + g][r] * x[r];
+			}
+
+			values[a + g] = rewards[a + g] + discount * dot;
+		}
+	}
+
+	for (; a < numActions; ++a) {
+		values[a] = rewards[a] + discount * denseDotAvx2(rows[a], x, n);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static int argmaxValueAvx2(const double *values, int count, double &best) {
+
+	const double lowest = -std::numeric_limits<double>::infinity();
+
+	//lane-wise maximum, then the first lane holding it
+	__m256d maximum = _mm256_set1_pd(lowest);
+
+	int a = 0;
+
+	for (; a + 4 <= count; a += 4) {
+		maximum = _mm256_max_pd(maximum, _mm256_loadu_pd(values + a));
+	}
+
+	__m128d half = _mm_max_pd(_mm256_castpd256_pd128(maximum),
+			_mm256_extractf128_pd(maximum, 1));
+	best = _mm_cvtsd_f64(_mm_max_sd(half, _mm_unpackhi_pd(half, half)));
+
+	for (int r = a; r < count; ++r) {
+		best = values[r] > best ? values[r] : best;
+	}
+
+	__m256d target = _mm256_set1_pd(best);
+
+	for (a = 0; a + 4 <= count; a += 4) {
+
+		int mask = _mm256_movemask_pd(
+				_mm256_cmp_pd(_mm256_loadu_pd(values + a), target, _CMP_EQ_OQ));
+
+		if (mask != 0) {
+			return a + __builtin_ctz(mask);
+		}
+	}
+
+	for (; a < count; ++a) {
+		if (values[a] == best) {
+			return a;
+		}
+	}
+
+	return 0;
+}
+
+//---------------------------------------------------------------- AVX-512
+
+//The unmasked AVX-512 casts, extracts, maxima and reductions are built on undefined registers that GCC
+//reports as uninitialized, so these kernels use masked forms with explicit zero or pass-through operands.
+
+//sum of the eight lanes
+__attribute__((target("avx512f")))
+static double horizontalSum512(__m512d v) {
+	return horizontalSum(
+			_mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 0),
+					_mm512_maskz_extractf64x4_pd(0xF, v, 1)));
+}
+
+//maximum of the eight lanes
+__attribute__((target("avx512f")))
+static double horizontalMax512(__m512d v) {
+
+	__m256d quarter = _mm256_max_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 0),
+			_mm512_maskz_extractf64x4_pd(0xF, v, 1));
+	__m128d half = _mm_max_pd(_mm256_castpd256_pd128(quarter),
+			_mm256_extractf128_pd(quarter, 1));
+
+	return _mm_cvtsd_f64(_mm_max_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+__attribute__((target("avx512f")))
+static double denseDotAvx512(const double *a, const double *b, std::size_t n) {
+
+	__m512d acc0 = _mm512_setzero_pd();
+	__m512d acc1 = _mm512_setzero_pd();
+
+	std::size_t j = 0;
+
+	for (; j + 16 <= n; j += 16) {
+		acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + j), _mm512_loadu_pd(b + j),
+				acc0);
+		acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + j + 8),
+				_mm512_loadu_pd(b + j + 8), acc1);
+	}
+
+	//the remainder is handled with a masked load instead of a scalar loop
+	for (; j < n; j += 8) {
+
+		__mmask8 mask = n - j >= 8 ? 0xFF : (__mmask8) ((1u << (n - j)) - 1);
+
+		acc0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a + j),
+				_mm512_maskz_loadu_pd(mask, b + j), acc0);
+	}
+
+	return horizontalSum512(_mm512_add_pd(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+static double sparseDotAvx512(const double *values, const int *columns,
+		std::size_t nnz, const double *x) {
+
+	__m512d acc = _mm512_setzero_pd();
+
+	for (std::size_t k = 0; k < nnz; k += 8) {
+
+		__mmask8 mask =
+				nnz - k >= 8 ? 0xFF : (__mmask8) ((1u << (nnz - k)) - 1);
+
+		__m256i index = _mm512_maskz_extracti64x4_epi64(0xF,
+				_mm512_maskz_loadu_epi32((__mmask16) mask, columns + k), 0);
+		__m512d gathered = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), mask,
+				index, x, 8);
+
+		acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, values + k),
+				gathered, acc);
+	}
+
+	return horizontalSum512(acc);
+}
+
+__attribute__((target("avx512f")))
+static void actionValuesAvx512(const double * const *rows,
+		const double *rewards, int numActions, const double *x, std::size_t n,
+		double discount, double *values) {
+
+	int a = 0;
+
+	//each chunk of x is loaded once for a group of actions
+	for (; a + actionGroup <= numActions; a += actionGroup) {
+
+		__m512d acc[actionGroup];
+
+		for (int g = 0; g < actionGroup; ++g) {
+			acc[g] = _mm512_setzero_pd();
+		}
+
+		for (std::size_t j = 0; j < n; j += 8) {
+
+			__mmask8 mask =
+					n - j >= 8 ? 0xFF : (__mmask8) ((1u << (n - j)) - 1);
+			__m512d xv = _mm512_maskz_loadu_pd(mask, x + j);
+
+			for (int g = 0; g < actionGroup; ++g) {
+				acc[g] = _mm512_fmadd_pd(
+						_mm512_maskz_loadu_pd(mask, rows[a + g] + j), xv,
+						acc[g]);
+			}
+		}
+
+		for (int g = 0; g < actionGroup; ++g) {
+			values[a + g] = rewards[a + g]
+					+ discount * horizontalSum512(acc[g]);
+		}
+	}
+
+	for (; a < numActions; ++a) {
+		values[a] = rewards[a] + discount * denseDotAvx512(rows[a], x, n);
+	}
+}
+
+__attribute__((target("avx512f")))
+static int argmaxValueAvx512(const double *values, int count, double &best) {
+
+	const __m512d lowest = _mm512_set1_pd(
+			-std::numeric_limits<double>::infinity());
+
+	//lane-wise maximum with masked tails, then the first lane holding it
+	__m512d maximum = lowest;
+
+	for (int a = 0; a < count; a += 8) {
+
+		__mmask8 mask =
+				count - a >= 8 ? 0xFF : (__mmask8) ((1u << (count - a)) - 1);
+
+		maximum = _mm512_mask_max_pd(maximum, 0xFF, maximum,
+				_mm512_mask_loadu_pd(lowest, mask, values + a));
+	}
+
+	best = horizontalMax512(maximum);
+
+	__m512d target = _mm512_set1_pd(best);
+
+	for (int a = 0; a < count; a += 8) {
+
+		__mmask8 mask =
+				count - a >= 8 ? 0xFF : (__mmask8) ((1u << (count - a)) - 1);
+		__mmask8 equal = _mm512_mask_cmp_pd_mask(mask,
+				_mm512_maskz_loadu_pd(mask, values + a), target, _CMP_EQ_OQ);
+
+		if (equal != 0) {
+			return a + __builtin_ctz(equal);
+		}
+	}
+
+	return 0;
+}
+
+//---------------------------------------------------------------- reproducible
+
+//Every reproducible reduction accumulates element k into lane k % 8, with a zero added to the lanes past
+//the end, and combines the lanes by the same fixed tree. The AVX2 kernel holds the lanes in two registers
+//and the scalar ones in an array, so both round identically. Multiplies and adds are never fused.
+static const int reductionLanes = 8;
+
+//((l0 + l1) + (l2 + l3)) + ((l4 + l5) + (l6 + l7))
+static double reduceLanes(const double *lanes) {
+	return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]))
+			+ ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+__attribute__((optimize("fp-contract=off")))
+static double treeSumScalar(const double *values, std::size_t n) {
+
+	double lanes[reductionLanes] = { 0.0 };
+
+	for (std::size_t k = 0; k < n; k += reductionLanes) {
+		for (int l = 0; l < reductionLanes; ++l) {
+			lanes[l] += k + l < n ? values[k + l] : 0.0;
+		}
+	}
+
+	return reduceLanes(lanes);
+}
+
+__attribute__((optimize("fp-contract=off")))
+static double denseDotReproducible(const double *a, const double *b,
+		std::size_t n) {
+
+	double lanes[reductionLanes] = { 0.0 };
+
+	for (std::size_t j = 0; j < n; j += reductionLanes) {
+		for (int l = 0; l < reductionLanes; ++l) {
+			lanes[l] += j + l < n ? a[j + l] * b[j + l] : 0.0;
+		}
+	}
+
+	return reduceLanes(lanes);
+}
+
+//AVX2 kernel with contraction off, so builds with FMA enabled globally do not fuse the multiply into the add
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+static double denseDotReproducibleAvx2(const double *a, const double *b,
+		std::size_t n) {
+
+	__m256d low = _mm256_setzero_pd();
+	__m256d high = _mm256_setzero_pd();
+
+	std::size_t j = 0;
+
+	for (; j + reductionLanes <= n; j += reductionLanes) {
+		low = _mm256_add_pd(low,
+				_mm256_mul_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(b + j)));
+		high = _mm256_add_pd(high,
+				_mm256_mul_pd(_mm256_loadu_pd(a + j + 4),
+						_mm256_loadu_pd(b + j + 4)));
+	}
+
+	if (j < n) {
+
+		//masked loads read zeros past the end, so the tail adds 0 * 0 like the scalar kernel
+		__m256i lane = _mm256_setr_epi64x(0, 1, 2, 3);
+		__m256i lowMask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n - j), lane);
+		__m256i highMask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n - j),
+				_mm256_add_epi64(lane, _mm256_set1_epi64x(4)));
+
+		low = _mm256_add_pd(low,
+				_mm256_mul_pd(_mm256_maskload_pd(a + j, lowMask),
+						_mm256_maskload_pd(b + j, lowMask)));
+		high = _mm256_add_pd(high,
+				_mm256_mul_pd(_mm256_maskload_pd(a + j + 4, highMask),
+						_mm256_maskload_pd(b + j + 4, highMask)));
+	}
+
+	double lanes[reductionLanes];
+
+	_mm256_storeu_pd(lanes, low);
+	_mm256_storeu_pd(lanes + 4, high);
+
+	return reduceLanes(lanes);
+}
+
+__attribute__((optimize("fp-contract=off")))
+static double sparseDotReproducible(const double *values, const int *columns,
+		std::size_t nnz, const double *x) {
+
+	double lanes[reductionLanes] = { 0.0 };
+
+	for (std::size_t k = 0; k < nnz; k += reductionLanes) {
+		for (int l = 0; l < reductionLanes; ++l) {
+			lanes[l] += k + l < nnz ? values[k + l] * x[columns[k + l]] : 0.0;
+		}
+	}
+
+	return reduceLanes(lanes);
+}
+
+__attribute__((optimize("fp-contract=off")))
+static void actionValuesReproducible(const double * const *rows,
+		const double *rewards, int numActions, const double *x, std::size_t n,
+		double discount, double *values) {
+
+	for (int a = 0; a < numActions; ++a) {
+		values[a] = rewards[a] + discount * denseDotReproducible(rows[a], x, n);
+	}
+}
+
+//same sums as actionValuesReproducible, by the AVX2 reproducible dot product
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+static void actionValuesReproducibleAvx2(const double * const *rows,
+		const double *rewards, int numActions, const double *x, std::size_t n,
+		double discount, double *values) {
+
+	for (int a = 0; a < numActions; ++a) {
+		values[a] = rewards[a]
+				+ discount * denseDotReproducibleAvx2(rows[a], x, n);
+	}
+}
+
+//---------------------------------------------------------------- dispatch
+
+//kernels of the selected instruction set
+struct kernelTable {
+	KernelInstructionSet instructionSet;
+	double (*denseDot)(const double *, const double *, std::size_t);
+	double (*sparseDot)(const double *, const int *, std::size_t,
+			const double *);
+	void (*actionValues)(const double * const *, const double *, int,
+			const double *, std::size_t, double, double *);
+	int (*argmaxValue)(const double *, int, double &);
+};
+
+static kernelTable makeTable(KernelInstructionSet instructionSet,
+		bool reproducible) {
+
+	kernelTable table = { SCALAR_KERNELS, denseDotScalar, sparseDotScalar,
+			actionValuesScalar, argmaxValueScalar };
+
+	//the argmax is exact, only the sums change
+	if (reproducible) {
+
+		table.instructionSet = instructionSet;
+		table.denseDot =
+				instructionSet >= AVX2_KERNELS ?
+						denseDotReproducibleAvx2 : denseDotReproducible;
+		table.sparseDot = sparseDotReproducible;
+		table.actionValues =
+				instructionSet >= AVX2_KERNELS ?
+						actionValuesReproducibleAvx2 : actionValuesReproducible;
+		table.argmaxValue =
+				instructionSet == AVX512_KERNELS ? argmaxValueAvx512 :
+				instructionSet == AVX2_KERNELS ?
+						argmaxValueAvx2 : argmaxValueScalar;
+
+		return table;
+	}
+
+	if (instructionSet == AVX512_KERNELS) {
+		kernelTable avx512 = { AVX512_KERNELS, denseDotAvx512, sparseDotAvx512,
+				actionValuesAvx512, argmaxValueAvx512 };
+		table = avx512;
+	} else if (instructionSet == AVX2_KERNELS) {
+		kernelTable avx2 = { AVX2_KERNELS, denseDotAvx2, sparseDotAvx2,
+				actionValuesAvx2, argmaxValueAvx2 };
+		table = avx2;
+	}
+
+	return table;
+}
+
+//tables of every instruction set and mode, built once and never written again
+struct kernelTables {
+
+	kernelTables() {
+		for (int isa = SCALAR_KERNELS; isa <= AVX512_KERNELS; ++isa) {
+			fast[isa] = makeTable((KernelInstructionSet) isa, false);
+			reproducible[isa] = makeTable((KernelInstructionSet) isa, true);
+		}
+	}
+
+	kernelTable fast[AVX512_KERNELS + 1];
+	kernelTable reproducible[AVX512_KERNELS + 1];
+};
+
+static const kernelTables &allTables() {
+	static const kernelTables tables;
+	return tables;
+}
+
+//instruction set dispatched to, shared by every thread
+static std::atomic<int> &dispatchedSet() {
+	static std::atomic<int> instructionSet(detectKernelInstructionSet());
+	return instructionSet;
+}
+
+//mode of the calls that do not give one
+static std::atomic<bool> &defaultReproducible() {
+	static std::atomic<bool> enabled(false);
+	return enabled;
+}
+
+//kernels of the dispatched instruction set in the given mode
+static const kernelTable &kernels(bool reproducible) {
+
+	const kernelTables &tables = allTables();
+	int instructionSet = dispatchedSet().load(std::memory_order_relaxed);
+
+	return reproducible ?
+			tables.reproducible[instructionSet] : tables.fast[instructionSet];
+}
+
+//kernels of the dispatched instruction set in the process default mode
+static const kernelTable &kernels() {
+	return kernels(defaultReproducible().load(std::memory_order_relaxed));
+}
+
+//widest instruction set supported by this CPU
+KernelInstructionSet detectKernelInstructionSet() {
+
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f")) {
+		return AVX512_KERNELS;
+	}
+
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return AVX2_KERNELS;
+	}
+
+	return SCALAR_KERNELS;
+}
+
+//instruction set the kernels currently dispatch to
+KernelInstructionSet kernelInstructionSet() {
+	return (KernelInstructionSet) dispatchedSet().load();
+}
+
+//dispatch to the given instruction set, capped at what the CPU supports
+void setKernelInstructionSet(KernelInstructionSet instructionSet) {
+
+	KernelInstructionSet supported = detectKernelInstructionSet();
+
+	dispatchedSet().store(
+			instructionSet < supported ? instructionSet : supported);
+}
+
+//dot product of two dense arrays of length n
+double denseDot(const double *a, const double *b, std::size_t n) {
+	return kernels().denseDot(a, b, n);
+}
+
+//dot product of two dense arrays of length n in the given mode
+double denseDot(const double *a, const double *b, std::size_t n,
+		bool reproducible) {
+	return kernels(reproducible).denseDot(a, b, n);
+}
+
+//dot product of a sparse row with a dense vector
+double sparseDot(const double *values, const int *columns, std::size_t nnz,
+		const double *x) {
+	return kernels().sparseDot(values, columns, nnz, x);
+}
+
+//dot product of a sparse row with a dense vector in the given mode
+double sparseDot(const double *values, const int *columns, std::size_t nnz,
+		const double *x, bool reproducible) {
+	return kernels(reproducible).sparseDot(values, columns, nnz, x);
+}
+
+//action values rewards[a] + discount * rows[a] . x of dense rows
+void actionValues(const double * const *rows, const double *rewards,
+		int numActions, const double *x, std::size_t n, double discount,
+		double *values) {
+	kernels().actionValues(rows, rewards, numActions, x, n, discount, values);
+}
+
+//action values of dense rows in the given mode
+void actionValues(const double * const *rows, const double *rewards,
+		int numActions, const double *x, std::size_t n, double discount,
+		double *values, bool reproducible) {
+	kernels(reproducible).actionValues(rows, rewards, numActions, x, n,
+			discount, values);
+}
+
+//index of the largest of count values, the lowest index on ties
+int argmaxValue(const double *values, int count, double &best) {
+	return kernels().argmaxValue(values, count, best);
+}
+
+//select the fixed order reductions (or the fastest ones again) for calls that do not give a mode
+void setReproducibleReductions(bool enabled) {
+	defaultReproducible().store(enabled);
+}
+
+//whether the fixed order reductions are selected for calls that do not give a mode
+bool reproducibleReductions() {
+	return defaultReproducible().load();
+}
+
+//sum of n values by the fixed reduction tree of the reproducible kernels
+double treeSum(const double *values, std::size_t n) {
+	return treeSumScalar(values, n);
+}
@@ -0,0 +1,74 @@
+/*
+ * BellmanKernels.hpp
+ *
+ *	Vectorized inner loops of the Bellman backup. Each kernel has a scalar, an AVX2 and an AVX-512
+ *	implementation, and the widest one the CPU supports is selected at runtime. A reproducible mode swaps
+ *	the sums for fixed order reductions that round the same on every instruction set.
+ *
+ *      Author: alexminnaar
+ */
+
+#ifndef BELLMANKERNELS_HPP_
+#define BELLMANKERNELS_HPP_
+
+#include<cstddef>
+
+//instruction sets the kernels are implemented for, narrowest first
+enum KernelInstructionSet {
+	SCALAR_KERNELS, AVX2_KERNELS, AVX512_KERNELS
+};
+
+//widest instruction set supported by this CPU
+KernelInstructionSet detectKernelInstructionSet();
+
+//instruction set the kernels currently dispatch to
+KernelInstructionSet kernelInstructionSet();
+
+//dispatch to the given instruction set, capped at what the CPU supports (mainly for testing the fallbacks).
+//The choice is process wide and may be changed while other threads run kernels
+void setKernelInstructionSet(KernelInstructionSet instructionSet);
+
+//select fixed order reductions: every dot product and sum accumulates element k into lane k % 8 and combines
+//the lanes by a fixed tree, without fused multiply-adds, so results are bit-identical whichever instruction set
+//is dispatched to (off by default, the fast kernels reassociate by instruction set). This is the process wide
+//default, used by the kernels called without a mode and taken by models when they are built; each MDP then
+//keeps its own mode (MDP::setReproducibleReductions) and passes it to every kernel it calls
+void setReproducibleReductions(bool enabled);
+
+//whether the fixed order reductions are the process wide default
+bool reproducibleReductions();
+
+//sum of n values by the fixed reduction tree of the reproducible kernels, whatever the mode
+double treeSum(const double *values, std::size_t n);
+
+//dot product of two dense arrays of length n
+double denseDot(const double *a, const double *b, std::size_t n);
+
+//dot product of two dense arrays of length n, with fixed order reductions if reproducible is set
+double denseDot(const double *a, const double *b, std::size_t n,
+		bool reproducible);
+
+//dot product of a sparse row (nnz values at the given columns) with a dense vector
+double sparseDot(const double *values, const int *columns, std::size_t nnz,
+		const double *x);
+
+//sparse dot product with fixed order reductions if reproducible is set
+double sparseDot(const double *values, const int *columns, std::size_t nnz,
+		const double *x, bool reproducible);
+
+//action values rewards[a] + discount * rows[a] . x for dense rows of length n, reading x once for
+//every group of actions
+void actionValues(const double * const *rows, const double *rewards,
+		int numActions, const double *x, std::size_t n, double discount,
+		double *values);
+
+//action values of dense rows with fixed order reductions if reproducible is set
+void actionValues(const double * const *rows, const double *rewards,
+		int numActions, const double *x, std::size_t n, double discount,
+		double *values, bool reproducible);
+
+//index of the largest of count values (the lowest such index on ties), without a branch per value.
+//The maximum is returned through best; count must be positive. The argmax is exact in either mode
+int argmaxValue(const double *values, int count, double &best);
+
+#endif /* BELLMANKERNELS_HPP_ */
@@ -6,19 +6,281 @@
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/matrix_proxy.hpp>
 #include<map>
+#include<queue>
+#include<vector>
+#include<cmath>
+#include<algorithm>
+#include<stdexcept>
+#include<thread>
 #include <boost/numeric/ublas/io.hpp>
+#include <boost/numeric/ublas/lu.hpp>
 #include "storage_adaptors.hpp"
 #include "MDP.hpp"
+#include "BellmanKernels.hpp"
+#include "ParallelRuntime.hpp"
 
 using namespace boost::numeric::ublas;
 
+const MDP::ActionIndex MDP::noAction;
+const int MDP::maxColors;
+
 //Constructor initializing all member variables
-MDP::MDP(std::map<int, matrix<double> > at, matrix<double> ar, double d) {
-	this->actionTransitions = at;
+MDP::MDP(std::map<int, matrix<double> > at, matrix<double> ar, double d) :
+		factoredPivots(0) {
 	this->actionReward = ar;
 	this->discount = d;
 	this->numStates = ar.size1();
 	this->numActions = at.size();
+	this->backupCount = 0;
+	this->evaluationScheme = JACOBI;
+	this->evaluationTolerance = 0.001;
+	this->inexactPolicyIteration = false;
+	this->andersonDepth = 5;
+	this->relaxation = 0.0;
+	this->maxUpdateRank = 16;
+	this->reorderStates = false;
+	this->tileSize = 0;
+	this->tileSteps = 4;
+	this->threadCount = 0;
+	this->numaPlacement = true;
+	this->hugePages = false;
+	this->reproducible = ::reproducibleReductions();
+	this->chunkWork = 0;
+	this->reachUnderPolicy = false;
+	this->goalMask.assign(this->numStates, false);
+	this->shortestPath = false;
+	this->generator.seed(5489u);
+
+	this->setTransitions(at);
+}
+
+//store the transitions as sparse or as padded dense rows, whichever the backups use
+void MDP::setTransitions(const std::map<int, matrix<double> > &at) {
+
+	std::size_t nonzeros = 0;
+
+	for (std::map<int, matrix<double> >::const_iterator it = at.begin();
+			it != at.end(); ++it) {
+		for (int i = 0; i < this->numStates; ++i) {
+			for (int j = 0; j < this->numStates; ++j) {
+				nonzeros += it->second(i, j) != 0.0;
+			}
+		}
+	}
+
+	//a gather costs several dense loads, so sparse rows only pay off well below full density
+	this->useSparseRows = nonzeros * 4
+			<= (std::size_t) this->numActions * this->numStates
+					* this->numStates;
+
+	//a cache line holds 8 doubles
+	this->rowStride = (this->numStates + 7) / 8 * 8;
+
+	this->sparseTransitions.clear();
+	this->paddedTransitions = std::vector<double, AlignedAllocator<double> >(
+			AlignedAllocator<double>(this->hugePages));
+
+	if (this->useSparseRows) {
+
+		for (std::map<int, matrix<double> >::const_iterator it = at.begin();
+				it != at.end(); ++it) {
+
+			sparseRows &sparse = this->sparseTransitions[it->first];
+
+			sparse.rowStart.assign(1, 0);
+
+			for (int i = 0; i < this->numStates; ++i) {
+				for (int j = 0; j < this->numStates; ++j) {
+
+					if (it->second(i, j) != 0.0) {
+						sparse.values.push_back(it->second(i, j));
+						sparse.columns.push_back(j);
+					}
+				}
+
+				sparse.rowStart.push_back(sparse.values.size());
+			}
+		}
+	} else {
+
+		//padding is zero so whole padded rows could be streamed
+		this->paddedTransitions.assign(
+				(std::size_t) this->numActions * this->numStates
+						* this->rowStride, 0.0);
+
+		for (std::map<int, matrix<double> >::const_iterator it = at.begin();
+				it != at.end(); ++it) {
+
+			for (int i = 0; i < this->numStates; ++i) {
+				std::copy(&it->second(i, 0),
+						&it->second(i, 0) + this->numStates,
+						this->paddedTransitions.begin()
+								+ (it->first * this->numStates + i)
+										* this->rowStride);
+			}
+		}
+	}
+
+	this->buildPredecessors();
+}
+
+//build the predecessor lists from the stored transitions
+void MDP::buildPredecessors() {
+
+	this->predecessors.assign(this->numStates, std::vector<int>());
+
+	//j is a predecessor of i if any action moves j to i; j increases, so each list comes out sorted
+	for (int j = 0; j < this->numStates; ++j) {
+		for (int a = 0; a < this->numActions; ++a) {
+
+			vector<double> successors = this->transitionRow(a, j);
+
+			for (int i = 0; i < this->numStates; ++i) {
+				if (successors(i) != 0.0
+						&& (this->predecessors[i].empty()
+								|| this->predecessors[i].back() != j)) {
+					this->predecessors[i].push_back(j);
+				}
+			}
+		}
+	}
+}
+
+//start of the padded dense row of the given action and state
+const double *MDP::paddedRow(int action, unsigned state) {
+	return &this->paddedTransitions[0]
+			+ ((std::size_t) action * this->numStates + state) * this->rowStride;
+}
+
+//probability that the action moves the state to the successor
+double MDP::transition(int action, unsigned state, unsigned successor) {
+
+	if (!this->useSparseRows) {
+		return this->paddedRow(action, state)[successor];
+	}
+
+	//columns of a row are sorted
+	const sparseRows &sparse = this->sparseTransitions.find(action)->second;
+	const int *first = sparse.columns.data() + sparse.rowStart[state];
+	const int *last = sparse.columns.data() + sparse.rowStart[state + 1];
+	const int *found = std::lower_bound(first, last, (int) successor);
+
+	return found != last && *found == (int) successor ?
+			sparse.values[found - sparse.columns.data()] : 0.0;
+}
+
+//transition probabilities of the action from the state to every state
+vector<double> MDP::transitionRow(int action, unsigned state) {
+
+	vector<double> successors(this->numStates);
+
+	if (!this->useSparseRows) {
+		std::copy(this->paddedRow(action, state),
+				this->paddedRow(action, state) + this->numStates,
+				successors.begin());
+		return successors;
+	}
+
+	successors.clear();
+
+	const sparseRows &sparse = this->sparseTransitions.find(action)->second;
+
+	for (int k = sparse.rowStart[state]; k < sparse.rowStart[state + 1]; ++k) {
+		successors(sparse.columns[k]) = sparse.values[k];
+	}
+
+	return successors;
+}
+
+//expected value of the action's successors of the state
+double MDP::expectedValue(int action, unsigned state, const double *valueFunc) {
+
+	if (this->useSparseRows) {
+
+		const sparseRows &sparse = this->sparseTransitions.find(action)->second;
+		const int begin = sparse.rowStart[state];
+
+		return sparseDot(sparse.values.data() + begin,
+				sparse.columns.data() + begin,
+				sparse.rowStart[state + 1] - begin, valueFunc,
+				this->reproducible);
+	}
+
+	return denseDot(this->paddedRow(action, state), valueFunc,
+			this->numStates, this->reproducible);
+}
+
+//value of taking the given action from the given state under the given value function
+double MDP::stateActionValue(unsigned state, int action,
+		const vector<double> &valueFunc) {
+	return this->actionReward(state, action)
+			+ this->discount
+					* this->expectedValue(action, state, &valueFunc(0));
+}
+
+//action values of every action at the given state, indexed by action
+void MDP::stateActionValues(unsigned state, const vector<double> &valueFunc,
+		double *values) {
+
+	//dense rows of every action at once share each load of the value function
+	const int maxFusedActions = 16;
+
+	if (!this->useSparseRows && this->numActions <= maxFusedActions) {
+
+		const double *rows[maxFusedActions];
+
+		for (int a = 0; a < this->numActions; ++a) {
+			rows[a] = this->paddedRow(a, state);
+		}
+
+		actionValues(rows, &this->actionReward(state, 0), this->numActions,
+				&valueFunc(0), this->numStates, this->discount, values,
+				this->reproducible);
+
+		return;
+	}
+
+	for (int a = 0; a < this->numActions; ++a) {
+		values[a] = this->stateActionValue(state, a, valueFunc);
+	}
+}
+
+//maximum action value at the given state (the maximizing action is returned through bestAction)
+double MDP::greedyBackup(unsigned state, const vector<double> &valueFunc,
+		int &bestAction) {
+
+	//the Q(s,.) block lives on the stack for the usual small action sets
+	const int stackActions = 16;
+
+	double stackValues[stackActions];
+	std::vector<double> heapValues;
+	double *values = stackValues;
+
+	if (this->numActions > stackActions) {
+		heapValues.resize(this->numActions);
+		values = &heapValues[0];
+	}
+
+	this->stateActionValues(state, valueFunc, values);
+
+	//disallowed actions can never be selected
+	if (!this->allowedActions.empty()) {
+		for (int a = 0; a < this->numActions; ++a) {
+			if (!this->isAllowed(state, a)) {
+				values[a] = -std::numeric_limits<double>::infinity();
+			}
+		}
+	}
+
+	//branchless argmax, ties go to the lowest action
+	double best;
+	bestAction = argmaxValue(values, this->numActions, best);
+
+	if (best == -std::numeric_limits<double>::infinity()) {
+		bestAction = -1;
+	}
+
+	return best;
 }
 
 //reward for each state associated with this policy (given the action reward and transition matrix for this MDP)
@@ -26,12 +288,25 @@ vector<double> MDP::policyReward(matrix<double> policy) {
 
 	vector<double> v(this->actionReward.size1());
 
+	//fixed order sums in reproducible mode
+	std::vector<double> terms(this->numActions);
+
 	for (unsigned i = 0; i < policy.size1(); ++i) {
 
 		matrix_row<matrix<double> > policyRow(policy, i);
 		matrix_row<matrix<double> > rewardRow(this->actionReward, i);
 
-		v(i) = sum(element_prod(policyRow, rewardRow));
+		if (this->reproducible) {
+
+			for (int a = 0; a < this->numActions; ++a) {
+				terms[a] = policyRow(a) * rewardRow(a);
+			}
+
+			v(i) = treeSum(terms.data(), this->numActions);
+
+		} else {
+			v(i) = sum(element_prod(policyRow, rewardRow));
+		}
 	}
 
 	return v;
@@ -40,17 +315,19 @@ vector<double> MDP::policyReward(matrix<double> policy) {
 //transition matrix associated with this policy (given the transition matrix for this MDP)
 matrix<double> MDP::policyTransitions(matrix<double> policy) {
 
-	matrix<double> ptp = zero_matrix<double>(3, 3);
+	matrix<double> ptp = zero_matrix<double>(this->numStates,
+			this->numStates);
 
 	for (unsigned i = 0; i < policy.size1(); ++i) {
 
-		for (std::map<int, matrix<double> >::iterator it =
-				this->actionTransitions.begin();
-				it != this->actionTransitions.end(); ++it) {
-
-			matrix_row<matrix<double> > atmRow(it->second, i);
+		if (!this->inSolveSet(i)) {
+			continue;
+		}
 
-			row(ptp, i) += atmRow * policy(i, it->first);
+		for (int a = 0; a < this->numActions; ++a) {
+			if (policy(i, a) != 0.0) {
+				row(ptp, i) += this->transitionRow(a, i) * policy(i, a);
+			}
 		}
 
 	}
@@ -62,24 +339,96 @@ matrix<double> MDP::policyTransitions(matrix<double> policy) {
 vector<double> MDP::bellmanEquation(matrix<double> policyTrans,
 		vector<double> policyRew, vector<double> valueFunc) {
 
-	return policyRew + this->discount * prod(policyTrans, valueFunc);
+	vector<double> result(policyRew.size());
+
+	for (unsigned i = 0; i < result.size(); ++i) {
+		result(i) = policyRew(i)
+				+ this->discount
+						* denseDot(&policyTrans(i, 0), &valueFunc(0),
+								valueFunc.size(), this->reproducible);
+	}
+
+	return result;
 }
 
 //Compute the value function associated with a given policy
 vector<double> MDP::policyEvaluation(matrix<double> pTransProb,
 		vector<double> pReward, double epsilon) {
 
+	if (this->evaluationScheme == ACTIVE_SET) {
+		return this->activeSetPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	if (this->evaluationScheme == ANDERSON) {
+		return this->andersonIteration(
+				[&](const vector<double> &valueFunc) {
+					return this->bellmanEquation(pTransProb, pReward, valueFunc);
+				}, pReward.size(), epsilon);
+	}
+
+	if (this->evaluationScheme == SOR) {
+		return this->sorPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	if (this->evaluationScheme == MOMENTUM) {
+		return this->momentumPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	if (this->evaluationScheme == MULTIGRID) {
+		return this->multigridPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	if (this->evaluationScheme == INCREMENTAL) {
+		return this->incrementalPolicyEvaluation(pTransProb, pReward);
+	}
+
+	if (this->evaluationScheme == BLOCKED) {
+		return this->blockedPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	if (this->evaluationScheme == COLORED) {
+		return this->coloredPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	return this->jacobiPolicyEvaluation(pTransProb, pReward, epsilon);
+}
+
+//Compute the value function of a policy by synchronous sweeps over the solved states
+vector<double> MDP::jacobiPolicyEvaluation(const matrix<double> &pTransProb,
+		const vector<double> &pReward, double epsilon) {
+
 	//Initialize value function to zero
 	vector<double> valueFunction = zero_vector<double>(pReward.size());
 
 	double delta = 10.0;
 
+	this->backupCount = 0;
+
 	while (delta > epsilon) {
 
 		vector<double> previousValueFunction = valueFunction;
 
 		//compute value function via the Bellman equation
-		valueFunction = bellmanEquation(pTransProb, pReward, valueFunction);
+		if (this->solveStates.empty()) {
+
+			valueFunction = bellmanEquation(pTransProb, pReward, valueFunction);
+			this->backupCount += valueFunction.size();
+
+		} else {
+
+			//only the reachable rows, the reachable set is closed under the policy
+			for (unsigned k = 0; k < this->solveStates.size(); ++k) {
+
+				int i = this->solveStates[k];
+
+				valueFunction(i) = pReward(i)
+						+ this->discount
+								* inner_prod(row(pTransProb, i),
+										previousValueFunction);
+			}
+
+			this->backupCount += this->solveStates.size();
+		}
 
 		//Check for convergence
 		vector<double> diffVect = valueFunction - previousValueFunction;
@@ -88,75 +437,3370 @@ vector<double> MDP::policyEvaluation(matrix<double> pTransProb,
 		vector<double>::iterator result;
 
 		//delta is most changed element (if it is small then convergence has occurred)
-		delta = *std::max_element(diffVect.begin(), diffVect.end());
+		delta = norm_inf(diffVect);
 	}
 
 	return valueFunction;
 }
 
-struct actionValue {
-	int action;
-	double value;
-};
+//Compute the value function associated with a given policy, only recomputing states with a changed successor value
+vector<double> MDP::activeSetPolicyEvaluation(matrix<double> pTransProb,
+		vector<double> pReward, double epsilon) {
 
-//Greedy policy improvement given the current policy's value function
-matrix<double> MDP::policyImprovement(vector<double> valueFunction) {
+	const unsigned n = pReward.size();
+	const unsigned words = (n + 63) / 64;
 
-	matrix<double> greedyPolicy = zero_matrix<double>(this->numStates,
-			this->numActions);
+	//predecessors of each state under this policy
+	std::vector<std::vector<unsigned> > policyPredecessors(n);
 
-	for (unsigned i = 0; i < numStates; ++i) {
+	for (unsigned i = 0; i < n; ++i) {
+		for (unsigned j = 0; j < n; ++j) {
+			if (pTransProb(i, j) != 0.0) {
+				policyPredecessors[j].push_back(i);
+			}
+		}
+	}
+
+	//changes of a state are held back from its predecessors until they add up to more than this, so the
+	//total change a predecessor has not yet seen stays below discount * negligible
+	const double negligible = epsilon * (1.0 - this->discount);
+
+	//sum of the changes of each state not yet propagated to its predecessors
+	std::vector<double> pending(n, 0.0);
+
+	//bitset frontier of states to recompute in the next sweep, initially every state
+	std::vector<unsigned long long> active(words, ~0ULL);
+	std::vector<unsigned long long> next(words);
+
+	if (n % 64 != 0) {
+		active[words - 1] = (1ULL << (n % 64)) - 1;
+	}
+
+	//when pruned to the reachable states, never recompute anything outside them
+	std::vector<unsigned long long> reachable(active);
+
+	if (!this->solveStates.empty()) {
+
+		std::fill(reachable.begin(), reachable.end(), 0ULL);
+
+		for (unsigned k = 0; k < this->solveStates.size(); ++k) {
+			int i = this->solveStates[k];
+			reachable[i / 64] |= 1ULL << (i % 64);
+		}
+
+		active = reachable;
+	}
+
+	vector<double> valueFunction = zero_vector<double>(n);
+
+	std::vector<unsigned> updated;
+	std::vector<double> updatedValues;
+
+	this->backupCount = 0;
+
+	double delta = 10.0;
+
+	while (delta > epsilon) {
+
+		updated.clear();
+		updatedValues.clear();
+
+		//Jacobi step over the active states, reading only the previous sweep's values
+		for (unsigned w = 0; w < words; ++w) {
+
+			unsigned long long bits = active[w];
+
+			while (bits) {
+
+				unsigned i = w * 64 + __builtin_ctzll(bits);
+				bits &= bits - 1;
+
+				updated.push_back(i);
+				updatedValues.push_back(
+						pReward(i)
+								+ this->discount
+										* inner_prod(row(pTransProb, i),
+												valueFunction));
+			}
+		}
+
+		this->backupCount += updated.size();
+
+		std::fill(next.begin(), next.end(), 0ULL);
+		delta = 0.0;
+
+		for (unsigned k = 0; k < updated.size(); ++k) {
 
-		actionValue greedyAction = { -1, 0.0 };
+			unsigned i = updated[k];
+			double change = std::fabs(updatedValues[k] - valueFunction(i));
 
-		for (std::map<int, matrix<double> >::iterator it =
-				this->actionTransitions.begin();
-				it != this->actionTransitions.end(); ++it) {
+			valueFunction(i) = updatedValues[k];
+			delta = std::max(delta, change);
 
-			//compute the value associated with this action at this state
-			double value = inner_prod(row(it->second, i), valueFunction)
-					+ this->actionReward(i, it->first);
+			//the predecessors must be recomputed once the state's held back changes stop being negligible
+			pending[i] += change;
 
-			//select the greedy action in terms of value
-			if (value > greedyAction.value) {
-				greedyAction.action = it->first;
-				greedyAction.value = value;
+			if (pending[i] > negligible) {
+
+				pending[i] = 0.0;
+
+				for (unsigned p = 0; p < policyPredecessors[i].size(); ++p) {
+					unsigned pred = policyPredecessors[i][p];
+					next[pred / 64] |= 1ULL << (pred % 64);
+				}
 			}
 		}
 
-		greedyPolicy(i, greedyAction.action) = 1.0;
+		for (unsigned w = 0; w < words; ++w) {
+			next[w] &= reachable[w];
+		}
+
+		active.swap(next);
 	}
 
-	return greedyPolicy;
+	return valueFunction;
 }
 
-//compute the optimal policy for this MDP (corresponding value function can be found using policyEvalution method)
-matrix<double> MDP::policyIteration() {
+//tolerance policyIteration evaluates each policy to
+void MDP::setEvaluationTolerance(double epsilon) {
+	this->evaluationTolerance = epsilon;
+}
 
-	//initialize with a random policy
-	matrix<double> currentPolicy = scalar_matrix<double>(this->numStates,
-			this->numActions);
+//inexact policy iteration with an evaluation tolerance tied to the Bellman optimality residual
+void MDP::setInexactPolicyIteration(bool enabled) {
+	this->inexactPolicyIteration = enabled;
+}
 
-	currentPolicy = currentPolicy / (double) this->numActions;
+//Compute the value function associated with a given policy by solving (I - discount * P) v = r directly
+vector<double> MDP::exactPolicyEvaluation(matrix<double> pTransProb,
+		vector<double> pReward) {
 
-	matrix<double> oldPolicy = zero_matrix<double>(this->numStates,
-			this->numActions);
+	const unsigned n = pReward.size();
+
+	matrix<double> system = identity_matrix<double>(n)
+			- this->discount * pTransProb;
+	permutation_matrix<std::size_t> pivots(n);
 
-	const double epsilon = std::numeric_limits<double>::epsilon();
+	if (lu_factorize(system, pivots) != 0) {
+		throw std::runtime_error(
+				"exactPolicyEvaluation: policy has no finite value function");
+	}
 
-	while (!detail::equals(currentPolicy, oldPolicy, epsilon, epsilon)) {
+	lu_substitute(system, pivots, pReward);
 
-		oldPolicy = currentPolicy;
+	return pReward;
+}
 
-		matrix<double> policyTrans = this->policyTransitions(currentPolicy);
+//number of changed policy rows applied as low rank updates before refactorizing
+void MDP::setMaxUpdateRank(int rank) {
+	this->maxUpdateRank = rank;
+}
 
-		vector<double> policyReward = this->policyReward(currentPolicy);
+//factorize I - discount * P for the given policy transition matrix
+void MDP::factorizePolicy(const matrix<double> &pTransProb) {
 
-		vector<double> policyValue = this->policyEvaluation(policyTrans,
-				policyReward, 0.001);
+	const unsigned n = pTransProb.size1();
 
-		currentPolicy = this->policyImprovement(policyValue);
+	this->factoredTransitions = pTransProb;
+	this->factoredSystem = identity_matrix<double>(n)
+			- this->discount * pTransProb;
+	this->factoredPivots = permutation_matrix<std::size_t>(n);
+	this->inverseColumns.clear();
+
+	if (lu_factorize(this->factoredSystem, this->factoredPivots) != 0) {
+		this->factoredTransitions.resize(0, 0);
+		throw std::runtime_error(
+				"factorizePolicy: policy has no finite value function");
 	}
+}
 
-	return currentPolicy;
+//Compute the value function of a policy from the cached factorization with low rank row updates
+vector<double> MDP::incrementalPolicyEvaluation(
+		const matrix<double> &pTransProb, const vector<double> &pReward) {
+
+	const unsigned n = pReward.size();
+
+	//rows of the system that differ from the factorized one
+	std::vector<int> changed;
+
+	if (this->factoredTransitions.size1() == n) {
+
+		for (unsigned i = 0; i < n; ++i) {
+
+			if (norm_inf(row(pTransProb, i) - row(this->factoredTransitions, i))
+					!= 0.0) {
+				changed.push_back(i);
+			}
+		}
+	}
+
+	if (this->factoredTransitions.size1() != n
+			|| (int) changed.size() > this->maxUpdateRank) {
+
+		this->factorizePolicy(pTransProb);
+		changed.clear();
+	}
+
+	vector<double> valueFunction = pReward;
+	lu_substitute(this->factoredSystem, this->factoredPivots, valueFunction);
+
+	this->backupCount = n;
+
+	const unsigned k = changed.size();
+
+	if (k == 0) {
+		return valueFunction;
+	}
+
+	//the new system is A + U D with U the changed states' unit columns and D their row changes:
+	//x = A^-1 r - Z (I + D Z)^-1 D A^-1 r with Z = A^-1 U
+	matrix<double> rowChanges(k, n);
+	matrix<double> inverseCols(n, k);
+
+	for (unsigned c = 0; c < k; ++c) {
+
+		int i = changed[c];
+
+		row(rowChanges, c) = -this->discount
+				* (row(pTransProb, i) - row(this->factoredTransitions, i));
+
+		std::map<int, vector<double> >::iterator cached =
+				this->inverseColumns.find(i);
+
+		if (cached == this->inverseColumns.end()) {
+
+			vector<double> unit = unit_vector<double>(n, i);
+			lu_substitute(this->factoredSystem, this->factoredPivots, unit);
+
+			cached = this->inverseColumns.insert(std::make_pair(i, unit)).first;
+		}
+
+		column(inverseCols, c) = cached->second;
+	}
+
+	matrix<double> capacitance = identity_matrix<double>(k)
+			+ prod(rowChanges, inverseCols);
+	vector<double> coefficients = prod(rowChanges, valueFunction);
+
+	permutation_matrix<std::size_t> pivots(k);
+
+	if (lu_factorize(capacitance, pivots) != 0) {
+
+		//the update is singular, solve the new system from scratch
+		this->factorizePolicy(pTransProb);
+
+		valueFunction = pReward;
+		lu_substitute(this->factoredSystem, this->factoredPivots,
+				valueFunction);
+
+		return valueFunction;
+	}
+
+	lu_substitute(capacitance, pivots, coefficients);
+
+	valueFunction -= prod(inverseCols, coefficients);
+
+	return valueFunction;
+}
+
+//select the iteration scheme used by policyEvaluation (and therefore policyIteration)
+void MDP::setEvaluationScheme(EvaluationScheme scheme) {
+	this->evaluationScheme = scheme;
+}
+
+//number of previous iterates mixed by Anderson acceleration
+void MDP::setAndersonDepth(int depth) {
+	this->andersonDepth = depth;
+}
+
+//iterate the map from zero until its residual is below epsilon, with Anderson acceleration
+vector<double> MDP::andersonIteration(FixedPointMap map, unsigned size,
+		double epsilon) {
+
+	//differences of successive residuals and map values, most recent last
+	std::vector<vector<double> > residualDiffs;
+	std::vector<vector<double> > mapDiffs;
+
+	vector<double> x = zero_vector<double>(size);
+	vector<double> previousResidual;
+	vector<double> previousMapped;
+
+	double previousNorm = std::numeric_limits<double>::infinity();
+
+	this->backupCount = 0;
+
+	while (true) {
+
+		vector<double> mapped = map(x);
+		vector<double> residual = mapped - x;
+		this->backupCount += size;
+
+		double norm = norm_inf(residual);
+
+		if (norm <= epsilon) {
+			return mapped;
+		}
+
+		//safeguard: an extrapolated iterate that made things worse is replaced by a plain step
+		if (norm > previousNorm) {
+
+			residualDiffs.clear();
+			mapDiffs.clear();
+			previousResidual.resize(0);
+
+			x = mapped;
+			previousNorm = norm;
+			continue;
+		}
+
+		if (previousResidual.size() != 0) {
+
+			residualDiffs.push_back(residual - previousResidual);
+			mapDiffs.push_back(mapped - previousMapped);
+
+			if ((int) residualDiffs.size() > this->andersonDepth) {
+				residualDiffs.erase(residualDiffs.begin());
+				mapDiffs.erase(mapDiffs.begin());
+			}
+		}
+
+		previousResidual = residual;
+		previousMapped = mapped;
+		previousNorm = norm;
+
+		const unsigned m = residualDiffs.size();
+
+		if (m == 0) {
+			x = mapped;
+			continue;
+		}
+
+		//least squares mixing coefficients from the (regularized) normal equations
+		matrix<double> gram(m, m);
+		vector<double> rhs(m);
+
+		for (unsigned i = 0; i < m; ++i) {
+
+			rhs(i) = inner_prod(residualDiffs[i], residual);
+
+			for (unsigned j = 0; j < m; ++j) {
+				gram(i, j) = inner_prod(residualDiffs[i], residualDiffs[j]);
+			}
+
+			gram(i, i) *= 1.0 + 1e-10;
+		}
+
+		permutation_matrix<std::size_t> pivots(m);
+
+		if (lu_factorize(gram, pivots) != 0) {
+
+			//degenerate history, restart from a plain step
+			residualDiffs.clear();
+			mapDiffs.clear();
+			x = mapped;
+			continue;
+		}
+
+		lu_substitute(gram, pivots, rhs);
+
+		x = mapped;
+
+		for (unsigned i = 0; i < m; ++i) {
+			x -= rhs(i) * mapDiffs[i];
+		}
+	}
+}
+
+//SOR relaxation factor, or 0 to estimate it from the first sweeps
+void MDP::setRelaxation(double omega) {
+	this->relaxation = omega;
+}
+
+//Compute the value function of a policy by successive over-relaxation
+vector<double> MDP::sorPolicyEvaluation(const matrix<double> &pTransProb,
+		const vector<double> &pReward, double epsilon) {
+
+	const unsigned n = pReward.size();
+
+	vector<double> valueFunction = zero_vector<double>(n);
+
+	this->backupCount = 0;
+
+	double omega = this->relaxation;
+	double delta = 10.0;
+	double previousDelta = std::numeric_limits<double>::infinity();
+
+	//estimate the Jacobi spectral radius from a few plain sweeps and apply Young's formula
+	if (omega <= 0.0) {
+
+		const int estimationSweeps = 5;
+
+		for (int k = 0; k < estimationSweeps && delta > epsilon; ++k) {
+
+			vector<double> updated = this->bellmanEquation(pTransProb, pReward,
+					valueFunction);
+			this->backupCount += n;
+
+			previousDelta = delta;
+			delta = norm_inf(updated - valueFunction);
+			valueFunction = updated;
+		}
+
+		double radius = std::min(delta / previousDelta, 1.0);
+
+		omega = 2.0 / (1.0 + std::sqrt(1.0 - radius * radius));
+		omega = std::max(1.0, std::min(omega, 1.95));
+	}
+
+	while (delta > epsilon) {
+
+		delta = 0.0;
+
+		for (unsigned i = 0; i < n; ++i) {
+
+			if (!this->inSolveSet(i)) {
+				continue;
+			}
+
+			//Gauss-Seidel value, solving the state's own self transition exactly
+			double selfLoop = this->discount * pTransProb(i, i);
+			double gaussSeidel = (pReward(i)
+					+ this->discount
+							* inner_prod(row(pTransProb, i), valueFunction)
+					- selfLoop * valueFunction(i)) / (1.0 - selfLoop);
+
+			double updated = valueFunction(i)
+					+ omega * (gaussSeidel - valueFunction(i));
+
+			delta = std::max(delta, std::fabs(updated - valueFunction(i)));
+			valueFunction(i) = updated;
+		}
+
+		this->backupCount += n;
+
+		//over-relaxation is only guaranteed for some models, back off towards Gauss-Seidel when it diverges
+		if (delta > previousDelta) {
+			omega = 1.0 + 0.5 * (omega - 1.0);
+		}
+
+		previousDelta = delta;
+	}
+
+	return valueFunction;
+}
+
+//Compute the value function of a policy by momentum accelerated sweeps
+vector<double> MDP::momentumPolicyEvaluation(const matrix<double> &pTransProb,
+		const vector<double> &pReward, double epsilon) {
+
+	const unsigned n = pReward.size();
+
+	//step size and momentum of accelerated value iteration for a discount factor
+	const double gamma = this->discount;
+	const double step = 1.0 / (1.0 + gamma);
+
+	//the limit as gamma goes to 0, where a single sweep is already exact
+	const double momentum =
+			gamma == 0.0 ? 0.0 : (1.0 - std::sqrt(1.0 - gamma * gamma)) / gamma;
+
+	vector<double> valueFunction = zero_vector<double>(n);
+	vector<double> previousValueFunction = valueFunction;
+
+	this->backupCount = 0;
+
+	double previousResidual = std::numeric_limits<double>::infinity();
+
+	while (true) {
+
+		vector<double> lookahead = valueFunction
+				+ momentum * (valueFunction - previousValueFunction);
+
+		vector<double> residual = this->bellmanEquation(pTransProb, pReward,
+				lookahead) - lookahead;
+		this->backupCount += n;
+
+		double norm = norm_inf(residual);
+
+		if (norm <= epsilon) {
+			return lookahead + residual;
+		}
+
+		previousValueFunction = valueFunction;
+
+		//restart the momentum when the residual grows
+		if (norm > previousResidual) {
+			valueFunction = lookahead + residual;
+			previousValueFunction = valueFunction;
+		} else {
+			valueFunction = lookahead + step * residual;
+		}
+
+		previousResidual = norm;
+	}
+}
+
+//one level of the multigrid hierarchy: the level's transitions in compressed sparse rows and the aggregate each
+//of its states joins. The coarsest level also keeps the LU factors of its system when it is solved directly
+struct aggregationLevel {
+
+	aggregationLevel() :
+			pivots(0) {
+	}
+
+	std::vector<double> values;
+	std::vector<int> columns;
+	std::vector<int> rowStart;
+	std::vector<unsigned> aggregate;
+	unsigned coarseSize;
+	bool direct;
+	matrix<double> factors;
+	permutation_matrix<std::size_t> pivots;
+};
+
+//number of states of a level
+static unsigned levelSize(const aggregationLevel &level) {
+	return level.rowStart.size() - 1;
+}
+
+//one Jacobi sweep rhs + discount * P v on the given level, with fixed order sums if reproducible is set
+static vector<double> relaxLevel(const aggregationLevel &level,
+		const vector<double> &rhs, const vector<double> &v, double discount,
+		bool reproducible) {
+
+	const unsigned n = levelSize(level);
+	vector<double> updated(n);
+
+	for (unsigned i = 0; i < n; ++i) {
+
+		const int begin = level.rowStart[i];
+
+		updated(i) = rhs(i)
+				+ discount
+						* sparseDot(level.values.data() + begin,
+								level.columns.data() + begin,
+								level.rowStart[i + 1] - begin, &v(0),
+								reproducible);
+	}
+
+	return updated;
+}
+
+//group each state with up to three strongly connected neighbours that are not aggregated yet. Neighbours are
+//the nonzeros of the state's row and column, so this costs O(nonzeros) rather than a scan of every state
+static unsigned aggregateStates(const aggregationLevel &level,
+		std::vector<unsigned> &aggregate) {
+
+	const unsigned n = levelSize(level);
+	const unsigned maxSize = 4;
+	const unsigned none = n;
+
+	//the columns of the level as rows of its transpose
+	std::vector<int> columnStart(n + 1, 0);
+	std::vector<int> rows(level.columns.size());
+	std::vector<double> columnValues(level.columns.size());
+
+	for (unsigned k = 0; k < level.columns.size(); ++k) {
+		++columnStart[level.columns[k] + 1];
+	}
+
+	for (unsigned j = 0; j < n; ++j) {
+		columnStart[j + 1] += columnStart[j];
+	}
+
+	std::vector<int> fill(columnStart.begin(), columnStart.end() - 1);
+
+	for (unsigned i = 0; i < n; ++i) {
+		for (int k = level.rowStart[i]; k < level.rowStart[i + 1]; ++k) {
+			int slot = fill[level.columns[k]]++;
+			rows[slot] = i;
+			columnValues[slot] = level.values[k];
+		}
+	}
+
+	aggregate.assign(n, none);
+
+	//connection strength P(i, j) + P(j, i) of each neighbour of the current state
+	std::vector<double> strength(n, 0.0);
+	std::vector<unsigned> neighbours;
+
+	unsigned count = 0;
+
+	for (unsigned i = 0; i < n; ++i) {
+
+		if (aggregate[i] != none) {
+			continue;
+		}
+
+		aggregate[i] = count;
+
+		neighbours.clear();
+
+		for (int k = level.rowStart[i]; k < level.rowStart[i + 1]; ++k) {
+
+			unsigned j = level.columns[k];
+
+			if (j != i && level.values[k] != 0.0) {
+				if (strength[j] == 0.0) {
+					neighbours.push_back(j);
+				}
+				strength[j] += level.values[k];
+			}
+		}
+
+		for (int k = columnStart[i]; k < columnStart[i + 1]; ++k) {
+
+			unsigned j = rows[k];
+
+			if (j != i && columnValues[k] != 0.0) {
+				if (strength[j] == 0.0) {
+					neighbours.push_back(j);
+				}
+				strength[j] += columnValues[k];
+			}
+		}
+
+		std::sort(neighbours.begin(), neighbours.end());
+
+		//a connection is strong if it is at least a quarter of the state's strongest one
+		double strongest = 0.0;
+
+		for (unsigned k = 0; k < neighbours.size(); ++k) {
+			strongest = std::max(strongest, strength[neighbours[k]]);
+		}
+
+		unsigned size = 1;
+
+		for (unsigned k = 0; k < neighbours.size(); ++k) {
+
+			unsigned j = neighbours[k];
+
+			if (size < maxSize && aggregate[j] == none
+					&& strength[j] >= 0.25 * strongest) {
+				aggregate[j] = count;
+				++size;
+			}
+
+			strength[j] = 0.0;
+		}
+
+		++count;
+	}
+
+	return count;
+}
+
+//coarse aggregated MDP of a level: average the rows of each aggregate and lump the columns
+static aggregationLevel coarsenLevel(const aggregationLevel &fine) {
+
+	const unsigned n = levelSize(fine);
+	const unsigned coarseSize = fine.coarseSize;
+
+	//fine states of each aggregate
+	std::vector<std::vector<unsigned> > members(coarseSize);
+
+	for (unsigned i = 0; i < n; ++i) {
+		members[fine.aggregate[i]].push_back(i);
+	}
+
+	aggregationLevel coarse;
+	coarse.rowStart.push_back(0);
+
+	std::vector<double> lumped(coarseSize, 0.0);
+	std::vector<char> seen(coarseSize, 0);
+	std::vector<int> touched;
+
+	for (unsigned a = 0; a < coarseSize; ++a) {
+
+		touched.clear();
+
+		for (unsigned m = 0; m < members[a].size(); ++m) {
+
+			unsigned i = members[a][m];
+
+			for (int k = fine.rowStart[i]; k < fine.rowStart[i + 1]; ++k) {
+
+				int b = fine.aggregate[fine.columns[k]];
+
+				if (!seen[b]) {
+					seen[b] = 1;
+					touched.push_back(b);
+				}
+
+				lumped[b] += fine.values[k];
+			}
+		}
+
+		std::sort(touched.begin(), touched.end());
+
+		for (unsigned k = 0; k < touched.size(); ++k) {
+
+			int b = touched[k];
+
+			coarse.columns.push_back(b);
+			coarse.values.push_back(lumped[b] / members[a].size());
+
+			lumped[b] = 0.0;
+			seen[b] = 0;
+		}
+
+		coarse.rowStart.push_back(coarse.columns.size());
+	}
+
+	return coarse;
+}
+
+//factorize the coarsest level's system I - discount * P if it is small enough and not singular to working
+//precision (as at discount 1 when the level has no leak); otherwise the level is only relaxed
+static void factorizeLevel(aggregationLevel &level, double discount,
+		unsigned directLimit) {
+
+	const unsigned n = levelSize(level);
+
+	level.direct = false;
+
+	if (n > directLimit) {
+		return;
+	}
+
+	level.factors = identity_matrix<double>(n);
+
+	for (unsigned i = 0; i < n; ++i) {
+		for (int k = level.rowStart[i]; k < level.rowStart[i + 1]; ++k) {
+			level.factors(i, level.columns[k]) -= discount * level.values[k];
+		}
+	}
+
+	level.pivots = permutation_matrix<std::size_t>(n);
+
+	if (lu_factorize(level.factors, level.pivots) != 0) {
+		return;
+	}
+
+	const double smallestPivot = 1e-12;
+
+	for (unsigned i = 0; i < n; ++i) {
+		if (std::fabs(level.factors(i, i)) < smallestPivot) {
+			return;
+		}
+	}
+
+	level.direct = true;
+}
+
+//one V-cycle for (I - discount * P) v = rhs on the given level, starting from v
+static vector<double> multigridCycle(std::vector<aggregationLevel> &levels,
+		unsigned level, const vector<double> &rhs, vector<double> v,
+		double discount, bool reproducible, long &backups) {
+
+	const aggregationLevel &current = levels[level];
+	const unsigned n = rhs.size();
+	const int smoothingSweeps = 2;
+
+	//coarsest level is solved directly, or relaxed when it is too large or singular
+	if (level + 1 == levels.size()) {
+
+		if (current.direct) {
+
+			vector<double> solution = rhs;
+			lu_substitute(current.factors, current.pivots, solution);
+
+			return solution;
+		}
+
+		const int coarseSweeps = 4 * smoothingSweeps;
+
+		for (int k = 0; k < coarseSweeps; ++k) {
+			v = relaxLevel(current, rhs, v, discount, reproducible);
+		}
+
+		backups += coarseSweeps * n;
+
+		return v;
+	}
+
+	for (int k = 0; k < smoothingSweeps; ++k) {
+		v = relaxLevel(current, rhs, v, discount, reproducible);
+	}
+
+	vector<double> residual = relaxLevel(current, rhs, v, discount, reproducible) - v;
+
+	backups += (smoothingSweeps + 1) * n;
+
+	//restrict the residual by averaging over each aggregate
+	const std::vector<unsigned> &aggregate = current.aggregate;
+	const unsigned coarse = current.coarseSize;
+
+	vector<double> coarseResidual = zero_vector<double>(coarse);
+	vector<double> sizes = zero_vector<double>(coarse);
+
+	for (unsigned i = 0; i < n; ++i) {
+		coarseResidual(aggregate[i]) += residual(i);
+		sizes(aggregate[i]) += 1.0;
+	}
+
+	coarseResidual = element_div(coarseResidual, sizes);
+
+	vector<double> correction = multigridCycle(levels, level + 1,
+			coarseResidual, zero_vector<double>(coarse), discount,
+			reproducible, backups);
+
+	//interpolate the correction back as a constant over each aggregate
+	for (unsigned i = 0; i < n; ++i) {
+		v(i) += correction(aggregate[i]);
+	}
+
+	for (int k = 0; k < smoothingSweeps; ++k) {
+		v = relaxLevel(current, rhs, v, discount, reproducible);
+	}
+
+	backups += smoothingSweeps * n;
+
+	return v;
+}
+
+//Compute the value function of a policy by aggregation multigrid V-cycles
+vector<double> MDP::multigridPolicyEvaluation(const matrix<double> &pTransProb,
+		const vector<double> &pReward, double epsilon) {
+
+	//levels are coarsened until they are small enough to solve directly or stop shrinking. A level that
+	//stopped shrinking above directLimit states is relaxed instead of being factorized
+	const unsigned directSize = 32;
+	const unsigned directLimit = 512;
+
+	const unsigned n = pReward.size();
+
+	std::vector<aggregationLevel> levels(1);
+	levels[0].rowStart.push_back(0);
+
+	for (unsigned i = 0; i < n; ++i) {
+
+		for (unsigned j = 0; j < n; ++j) {
+			if (pTransProb(i, j) != 0.0) {
+				levels[0].columns.push_back(j);
+				levels[0].values.push_back(pTransProb(i, j));
+			}
+		}
+
+		levels[0].rowStart.push_back(levels[0].columns.size());
+	}
+
+	while (levelSize(levels.back()) > directSize) {
+
+		aggregationLevel &fine = levels.back();
+		const unsigned fineSize = levelSize(fine);
+
+		fine.coarseSize = aggregateStates(fine, fine.aggregate);
+
+		if (fine.coarseSize * 10 > fineSize * 9) {
+			break;
+		}
+
+		levels.push_back(coarsenLevel(fine));
+	}
+
+	factorizeLevel(levels.back(), this->discount, directLimit);
+
+	vector<double> valueFunction = zero_vector<double>(n);
+
+	this->backupCount = 0;
+
+	double delta = 10.0;
+
+	while (delta > epsilon) {
+
+		valueFunction = multigridCycle(levels, 0, pReward, valueFunction,
+				this->discount, this->reproducible, this->backupCount);
+
+		delta = norm_inf(
+				this->bellmanEquation(pTransProb, pReward, valueFunction)
+						- valueFunction);
+		this->backupCount += n;
+	}
+
+	return valueFunction;
+}
+
+//tile shape of the BLOCKED scheme
+void MDP::setTiling(int rows, int steps) {
+
+	//without a relaxation step no state would ever be backed up
+	if (rows < 0 || steps <= 0) {
+		throw std::invalid_argument(
+				"setTiling: rows must be non-negative and steps positive");
+	}
+
+	this->tileSize = rows;
+	this->tileSteps = steps;
+}
+
+//Compute the value function of a policy by cache blocked sweeps
+vector<double> MDP::blockedPolicyEvaluation(const matrix<double> &pTransProb,
+		const vector<double> &pReward, double epsilon) {
+
+	const unsigned n = pReward.size();
+
+	//largest diagonal block of doubles that fits a 256KB L2 cache
+	unsigned tile = this->tileSize > 0 ? this->tileSize : 180;
+	tile = std::min(tile, n);
+
+	vector<double> valueFunction = zero_vector<double>(n);
+
+	//contribution of the rows outside the tile's own columns, computed once per sweep
+	std::vector<double> outside(tile);
+
+	this->backupCount = 0;
+
+	double delta = 10.0;
+
+	while (delta > epsilon) {
+
+		delta = 0.0;
+
+		for (unsigned begin = 0; begin < n; begin += tile) {
+
+			const unsigned end = std::min(begin + tile, n);
+
+			//stream the tile's rows from memory once
+			for (unsigned i = begin; i < end; ++i) {
+
+				const double *transRow = &pTransProb(i, 0);
+
+				outside[i - begin] = denseDot(transRow, &valueFunction(0), n,
+						this->reproducible)
+						- denseDot(transRow + begin, &valueFunction(begin),
+								end - begin, this->reproducible);
+			}
+
+			//every relaxation step backs up each row of the tile once
+			this->backupCount += (long) this->tileSteps * (end - begin);
+
+			//relax on the diagonal block, which stays in cache, in place
+			for (int step = 0; step < this->tileSteps; ++step) {
+
+				for (unsigned i = begin; i < end; ++i) {
+
+					double updated = pReward(i)
+							+ this->discount
+									* (outside[i - begin]
+											+ denseDot(&pTransProb(i, begin),
+													&valueFunction(begin),
+													end - begin,
+													this->reproducible));
+
+					delta = std::max(delta,
+							std::fabs(updated - valueFunction(i)));
+					valueFunction(i) = updated;
+				}
+			}
+		}
+	}
+
+	return valueFunction;
+}
+
+//one synchronous sweep of greedy backups over the solved states
+vector<double> MDP::greedySweep(const vector<double> &valueFunc) {
+
+	vector<double> updated = valueFunc;
+	int action;
+
+	for (int i = 0; i < this->numStates; ++i) {
+		if (this->inSolveSet(i)) {
+			updated(i) = this->greedyBackup(i, valueFunc, action);
+		}
+	}
+
+	return updated;
+}
+
+//compute the optimal value function by synchronous value iteration
+vector<double> MDP::valueIteration(double epsilon) {
+
+	if (this->reorderStates) {
+
+		vector<double> localValue = this->reordered().valueIteration(epsilon);
+		vector<double> valueFunction(this->numStates);
+
+		for (int k = 0; k < this->numStates; ++k) {
+			valueFunction(this->reorderedOrder[k]) = localValue(k);
+		}
+
+		this->takeReorderedResults();
+
+		return valueFunction;
+	}
+
+	if (this->evaluationScheme == ANDERSON) {
+		return this->andersonIteration(
+				[this](const vector<double> &valueFunc) {
+					return this->greedySweep(valueFunc);
+				}, this->numStates, epsilon);
+	}
+
+	vector<double> valueFunction = zero_vector<double>(this->numStates);
+
+	this->backupCount = 0;
+
+	double delta = 10.0;
+
+	while (delta > epsilon) {
+
+		vector<double> updated = this->greedySweep(valueFunction);
+		this->backupCount += this->numStates;
+
+		delta = norm_inf(updated - valueFunction);
+		valueFunction = updated;
+	}
+
+	return valueFunction;
+}
+
+//Greedy policy improvement given the current policy's value function
+matrix<double> MDP::policyImprovement(vector<double> valueFunction) {
+
+	matrix<double> greedyPolicy = zero_matrix<double>(this->numStates,
+			this->numActions);
+
+	for (unsigned i = 0; i < numStates; ++i) {
+
+		//unreachable states are left without an action
+		if (!this->inSolveSet(i)) {
+			continue;
+		}
+
+		//select the greedy action in terms of value, states without an allowed action get none
+		int greedyAction;
+		this->greedyBackup(i, valueFunction, greedyAction);
+
+		if (greedyAction >= 0) {
+			greedyPolicy(i, greedyAction) = 1.0;
+		}
+	}
+
+	return greedyPolicy;
+}
+
+//compute the optimal policy for this MDP (corresponding value function can be found using policyEvalution method)
+matrix<double> MDP::policyIteration() {
+
+	if (this->reorderStates) {
+
+		matrix<double> policy = this->fromReordered(
+				this->reordered().policyIteration());
+
+		this->takeReorderedResults();
+		this->cachedOptimalPolicy = policy;
+
+		return policy;
+	}
+
+	//initialize with a random policy
+	matrix<double> currentPolicy = scalar_matrix<double>(this->numStates,
+			this->numActions);
+
+	currentPolicy = currentPolicy / (double) this->numActions;
+
+	//a random policy may never reach a goal, so shortest path problems start from a proper one
+	if (this->shortestPath) {
+		currentPolicy = this->properInitialPolicy;
+	}
+
+	solveScope scope(*this);
+	this->restrictSolveStates(matrix<double>());
+
+	return this->policyIteration(currentPolicy);
+}
+
+//policy iteration from the given initial policy
+matrix<double> MDP::policyIteration(matrix<double> currentPolicy) {
+
+	//a restriction to the states reachable under the policy ends with this call
+	solveScope scope(*this);
+
+	matrix<double> policyTrans = this->policyTransitions(currentPolicy);
+	vector<double> policyReward = this->policyReward(currentPolicy);
+
+	std::vector<int> changedStates;
+
+	double tolerance = this->evaluationTolerance;
+	long totalBackups = 0;
+
+	bool converged = false;
+
+	while (!converged) {
+
+		//the solved states follow the policy, so every row may change
+		if (this->reachUnderPolicy) {
+			this->restrictSolveStates(currentPolicy);
+			policyTrans = this->policyTransitions(currentPolicy);
+			policyReward = this->policyReward(currentPolicy);
+		}
+
+		//the first policy is evaluated relative to the scale of its rewards
+		if (this->inexactPolicyIteration && totalBackups == 0) {
+			tolerance = std::max(this->evaluationTolerance,
+					0.1 * norm_inf(policyReward));
+		}
+
+		vector<double> policyValue = this->policyEvaluation(policyTrans,
+				policyReward, tolerance);
+		totalBackups += this->backupCount;
+
+		currentPolicy = this->policyImprovement(policyValue, currentPolicy,
+				changedStates);
+
+		converged = changedStates.empty();
+
+		if (tolerance > this->evaluationTolerance) {
+
+			if (converged) {
+
+				//an unchanged policy is only trusted once evaluated at the final tolerance
+				tolerance = this->evaluationTolerance;
+				converged = false;
+
+			} else {
+
+				//tighten with the Bellman optimality residual of the evaluated values
+				double residual = norm_inf(
+						this->greedySweep(policyValue) - policyValue);
+				totalBackups += this->numStates;
+
+				tolerance = std::max(this->evaluationTolerance,
+						std::min(tolerance, 0.1 * residual));
+			}
+		}
+
+		//only the states whose action changed need their rows recomputed
+		this->updatePolicyRows(currentPolicy, changedStates, policyTrans,
+				policyReward);
+	}
+
+	this->backupCount = totalBackups;
+	this->cachedOptimalPolicy = currentPolicy;
+
+	return currentPolicy;
+}
+
+//replace the reward matrix, keeping the transitions
+void MDP::setActionReward(matrix<double> reward) {
+
+	this->actionReward = reward;
+
+	//the renumbered copy keeps its factorization too
+	if (this->reorderedModel) {
+
+		for (int k = 0; k < this->numStates; ++k) {
+			row(reward, k) = row(this->actionReward, this->reorderedOrder[k]);
+		}
+
+		this->reorderedModel->setActionReward(reward);
+	}
+}
+
+//recompute the optimal policy after a reward change, reusing the last optimal policy's factorization
+matrix<double> MDP::resolvePolicy() {
+
+	if (this->reorderStates) {
+
+		matrix<double> policy = this->fromReordered(
+				this->reordered().resolvePolicy());
+
+		this->takeReorderedResults();
+		this->cachedOptimalPolicy = policy;
+
+		return policy;
+	}
+
+	if (this->cachedOptimalPolicy.size1() == 0) {
+		return this->policyIteration();
+	}
+
+	matrix<double> policy = this->cachedOptimalPolicy;
+
+	//the same states as policyIteration's last pass, so goals, improper and unreachable states stay without an action
+	solveScope scope(*this);
+	this->restrictSolveStates(
+			this->reachUnderPolicy ? policy : matrix<double>());
+
+	matrix<double> policyTrans = this->policyTransitions(policy);
+
+	//the factorization survives as long as the optimal policy's transitions are unchanged
+	if (this->factoredTransitions.size1() != policyTrans.size1()
+			|| norm_inf(policyTrans - this->factoredTransitions) != 0.0) {
+		this->factorizePolicy(policyTrans);
+	}
+
+	vector<double> policyValue = this->policyReward(policy);
+	lu_substitute(this->factoredSystem, this->factoredPivots, policyValue);
+
+	std::vector<int> changedStates;
+	matrix<double> improvedPolicy = this->policyImprovement(policyValue,
+			policy, changedStates);
+
+	this->backupCount = this->numStates;
+
+	if (changedStates.empty()) {
+		return policy;
+	}
+
+	long verificationBackups = this->backupCount;
+
+	matrix<double> optimalPolicy = this->policyIteration(improvedPolicy);
+	this->backupCount += verificationBackups;
+
+	return optimalPolicy;
+}
+
+//Greedy policy improvement that keeps the current action on ties and reports the states whose action changed
+matrix<double> MDP::policyImprovement(vector<double> valueFunction,
+		matrix<double> currentPolicy, std::vector<int> &changedStates) {
+
+	matrix<double> greedyPolicy = zero_matrix<double>(this->numStates,
+			this->numActions);
+
+	changedStates.clear();
+
+	for (int i = 0; i < this->numStates; ++i) {
+
+		//unreachable states are left without an action
+		if (!this->inSolveSet(i)) {
+			continue;
+		}
+
+		int action;
+		double best = this->greedyBackup(i, valueFunction, action);
+
+		//states without an allowed action get none
+		if (action < 0) {
+			continue;
+		}
+
+		//a deterministic current action that is still greedy is kept
+		for (int a = 0; a < this->numActions; ++a) {
+
+			if (currentPolicy(i, a) == 1.0 && a != action
+					&& this->isAllowed(i, a)
+					&& this->stateActionValue(i, a, valueFunction) >= best) {
+				action = a;
+			}
+		}
+
+		greedyPolicy(i, action) = 1.0;
+
+		if (currentPolicy(i, action) != 1.0) {
+			changedStates.push_back(i);
+		}
+	}
+
+	return greedyPolicy;
+}
+
+//recompute the given states' rows of the policy transition matrix and policy reward vector for a new policy
+void MDP::updatePolicyRows(matrix<double> policy, std::vector<int> states,
+		matrix<double> &policyTrans, vector<double> &policyRew) {
+
+	for (unsigned k = 0; k < states.size(); ++k) {
+
+		int i = states[k];
+
+		matrix_row<matrix<double> > transRow(policyTrans, i);
+		transRow = zero_vector<double>(this->numStates);
+
+		policyRew(i) = 0.0;
+
+		for (int a = 0; a < this->numActions; ++a) {
+
+			double probability = policy(i, a);
+
+			if (probability != 0.0) {
+				transRow += probability * this->transitionRow(a, i);
+				policyRew(i) += probability * this->actionReward(i, a);
+			}
+		}
+	}
+}
+
+//compute the optimal policy by value iteration sweeps, switching to policy iteration with exact evaluation
+matrix<double> MDP::hybridIteration(double epsilon) {
+
+	vector<double> valueFunction = zero_vector<double>(this->numStates);
+	vector<double> updated(this->numStates);
+
+	std::vector<int> greedy(this->numStates, -1);
+	std::vector<int> previousGreedy;
+
+	//an LU evaluation costs about n^3 / 3 operations against n^2 * numActions for a sweep
+	const double evaluationSweeps = this->numStates
+			/ (3.0 * this->numActions);
+
+	const int stableSweeps = 2;
+	int stable = 0;
+
+	double residual = std::numeric_limits<double>::infinity();
+
+	this->backupCount = 0;
+
+	//shortest path goals and improper states are left out of the solve as in policy iteration
+	solveScope scope(*this);
+	this->restrictSolveStates(matrix<double>());
+
+	while (true) {
+
+		previousGreedy = greedy;
+
+		for (int i = 0; i < this->numStates; ++i) {
+
+			//unreachable states and states without an allowed action keep value 0 and no action
+			updated(i) = 0.0;
+
+			if (this->inSolveSet(i)) {
+
+				double value = this->greedyBackup(i, valueFunction, greedy[i]);
+
+				if (greedy[i] >= 0) {
+					updated(i) = value;
+				}
+			}
+		}
+
+		this->backupCount += this->numStates;
+
+		double previousResidual = residual;
+		residual = norm_inf(updated - valueFunction);
+		valueFunction.swap(updated);
+
+		if (residual <= epsilon) {
+			break;
+		}
+
+		stable = greedy == previousGreedy ? stable + 1 : 0;
+
+		//sweeps value iteration still needs at the observed contraction rate
+		double rate = residual / previousResidual;
+		double remaining =
+				rate < 1.0 ?
+						std::log(epsilon / residual) / std::log(rate) :
+						std::numeric_limits<double>::infinity();
+
+		if (stable >= stableSweeps && remaining > evaluationSweeps) {
+
+			//policy iteration from the stable greedy policy
+			matrix<double> currentPolicy = zero_matrix<double>(
+					this->numStates, this->numActions);
+			matrix<double> oldPolicy;
+
+			for (int i = 0; i < this->numStates; ++i) {
+				if (greedy[i] >= 0) {
+					currentPolicy(i, greedy[i]) = 1.0;
+				}
+			}
+
+			const double tolerance = std::numeric_limits<double>::epsilon();
+
+			do {
+
+				oldPolicy = currentPolicy;
+
+				vector<double> policyValue = this->exactPolicyEvaluation(
+						this->policyTransitions(currentPolicy),
+						this->policyReward(currentPolicy));
+				this->backupCount += this->numStates;
+
+				currentPolicy = this->policyImprovement(policyValue);
+
+			} while (!detail::equals(currentPolicy, oldPolicy, tolerance,
+					tolerance));
+
+			return currentPolicy;
+		}
+	}
+
+	return this->policyImprovement(valueFunction);
+}
+
+//compute the optimal value function by prioritized sweeping, backing up the state with the largest Bellman residual first
+vector<double> MDP::prioritizedSweeping(double epsilon, long budget) {
+
+	vector<double> valueFunction = zero_vector<double>(this->numStates);
+
+	//current Bellman residual of every state
+	std::vector<double> residual(this->numStates);
+
+	//max-heap of (residual, state); entries whose residual is out of date are skipped when popped
+	std::priority_queue<std::pair<double, int> > queue;
+
+	int action;
+
+	for (int i = 0; i < this->numStates; ++i) {
+
+		if (!this->inSolveSet(i)) {
+			continue;
+		}
+
+		residual[i] = std::fabs(
+				this->greedyBackup(i, valueFunction, action)
+						- valueFunction(i));
+
+		if (residual[i] > epsilon) {
+			queue.push(std::make_pair(residual[i], i));
+		}
+	}
+
+	this->backupCount = 0;
+
+	while (!queue.empty() && (budget <= 0 || this->backupCount < budget)) {
+
+		std::pair<double, int> top = queue.top();
+		queue.pop();
+
+		int state = top.second;
+
+		//stale entry, the state has been backed up or re-prioritized since it was pushed
+		if (top.first != residual[state]) {
+			continue;
+		}
+
+		valueFunction(state) = this->greedyBackup(state, valueFunction, action);
+		residual[state] = 0.0;
+		++this->backupCount;
+
+		//only the predecessors of the updated state can have a changed residual
+		for (unsigned k = 0; k < this->predecessors[state].size(); ++k) {
+
+			int pred = this->predecessors[state][k];
+
+			if (!this->inSolveSet(pred)) {
+				continue;
+			}
+
+			residual[pred] = std::fabs(
+					this->greedyBackup(pred, valueFunction, action)
+							- valueFunction(pred));
+
+			if (residual[pred] > epsilon) {
+				queue.push(std::make_pair(residual[pred], pred));
+			}
+		}
+	}
+
+	return valueFunction;
+}
+
+//number of single-state Bellman backups performed by the most recent solver call
+long MDP::getBackupCount() {
+	return this->backupCount;
+}
+
+//only solve for states reachable from the given start states
+void MDP::setInitialStates(std::vector<int> states, bool underPolicy) {
+	this->initialStates = states;
+	this->reachUnderPolicy = underPolicy;
+	this->reorderedModel.reset();
+}
+
+//only solve for states reachable from the support of the given initial state distribution
+void MDP::setInitialDistribution(vector<double> distribution,
+		bool underPolicy) {
+
+	std::vector<int> states;
+
+	for (unsigned i = 0; i < distribution.size(); ++i) {
+		if (distribution(i) > 0.0) {
+			states.push_back(i);
+		}
+	}
+
+	this->setInitialStates(states, underPolicy);
+}
+
+//states reachable from the initial states, following only the actions the given policy takes
+std::vector<int> MDP::reachableStates(matrix<double> policy) {
+
+	std::vector<bool> visited(this->numStates, false);
+	std::vector<int> reached;
+
+	//breadth first search from the initial states
+	std::queue<int> frontier;
+
+	for (unsigned k = 0; k < this->initialStates.size(); ++k) {
+
+		int state = this->initialStates[k];
+
+		if (!visited[state]) {
+			visited[state] = true;
+			frontier.push(state);
+		}
+	}
+
+	while (!frontier.empty()) {
+
+		int state = frontier.front();
+		frontier.pop();
+
+		reached.push_back(state);
+
+		for (int a = 0; a < this->numActions; ++a) {
+
+			if (policy.size1() != 0 && policy(state, a) == 0.0) {
+				continue;
+			}
+
+			vector<double> successors = this->transitionRow(a, state);
+
+			for (int j = 0; j < this->numStates; ++j) {
+
+				if (successors(j) != 0.0 && !visited[j]) {
+					visited[j] = true;
+					frontier.push(j);
+				}
+			}
+		}
+	}
+
+	std::sort(reached.begin(), reached.end());
+
+	return reached;
+}
+
+//restrict solveStates to the states reachable under the given policy
+void MDP::restrictSolveStates(matrix<double> policy) {
+
+	this->solveStates.clear();
+	this->solvedMask.clear();
+	this->coveredMask.clear();
+
+	if (this->initialStates.empty() && !this->shortestPath) {
+		return;
+	}
+
+	std::vector<bool> solved(this->numStates, this->initialStates.empty());
+
+	if (!this->initialStates.empty()) {
+
+		std::vector<int> reachable = this->reachableStates(policy);
+
+		for (unsigned k = 0; k < reachable.size(); ++k) {
+			solved[reachable[k]] = true;
+		}
+	}
+
+	//goals keep their zero value and improper states cannot be solved
+	if (this->shortestPath) {
+		for (int i = 0; i < this->numStates; ++i) {
+			solved[i] = solved[i] && this->properMask[i] && !this->goalMask[i];
+		}
+	}
+
+	this->solvedMask = solved;
+
+	for (int i = 0; i < this->numStates; ++i) {
+		if (solved[i]) {
+			this->solveStates.push_back(i);
+		}
+	}
+
+	this->labelSolved(solved);
+}
+
+//remember the restriction in effect
+MDP::solveScope::solveScope(MDP &mdp) :
+		mdp(mdp), states(mdp.solveStates), mask(mdp.solvedMask) {
+}
+
+//put the remembered restriction back
+MDP::solveScope::~solveScope() {
+	this->mdp.solveStates.swap(this->states);
+	this->mdp.solvedMask.swap(this->mask);
+}
+
+//whether the solve in progress covers this state
+bool MDP::inSolveSet(int state) {
+	return this->solvedMask.empty() || this->solvedMask[state];
+}
+
+//whether the last solve covered this state
+bool MDP::isSolved(int state) {
+	return this->coveredMask.empty() || this->coveredMask[state];
+}
+
+//mark the given states as absorbing goals with zero value
+void MDP::setGoalStates(std::vector<int> goals) {
+
+	this->goalMask.assign(this->numStates, false);
+
+	for (unsigned k = 0; k < goals.size(); ++k) {
+		this->goalMask[goals[k]] = true;
+	}
+
+	this->reorderedModel.reset();
+}
+
+//whether the state is an absorbing goal
+bool MDP::isGoal(int state) {
+	return this->goalMask[state];
+}
+
+//states that every action keeps in place with probability 1 and zero reward
+std::vector<int> MDP::absorbingStates() {
+
+	std::vector<int> absorbing;
+
+	for (int i = 0; i < this->numStates; ++i) {
+
+		bool stays = true;
+
+		for (int a = 0; a < this->numActions && stays; ++a) {
+			stays = this->transition(a, i, i) == 1.0
+					&& this->actionReward(i, a) == 0.0;
+		}
+
+		if (stays) {
+			absorbing.push_back(i);
+		}
+	}
+
+	return absorbing;
+}
+
+//solve the MDP as a stochastic shortest path problem
+void MDP::setStochasticShortestPath(bool enabled) {
+
+	this->shortestPath = enabled;
+	this->allowedActions.clear();
+	this->reorderedModel.reset();
+
+	if (!enabled) {
+		return;
+	}
+
+	//goals are detected once, on top of any set explicitly
+	std::vector<int> absorbing = this->absorbingStates();
+
+	for (unsigned k = 0; k < absorbing.size(); ++k) {
+		this->goalMask[absorbing[k]] = true;
+	}
+
+	this->findProperStates();
+}
+
+//whether the action may be taken from the state
+bool MDP::isAllowed(unsigned state, int action) {
+	return this->allowedActions.empty()
+			|| this->allowedActions[state * this->numActions + action];
+}
+
+//compute properMask, allowedActions and properInitialPolicy from the goal states
+void MDP::findProperStates() {
+
+	//candidate proper states, shrunk until every one of them reaches a goal using only actions that stay inside
+	std::vector<bool> candidate(this->numStates, true);
+
+	this->properInitialPolicy = zero_matrix<double>(this->numStates,
+			this->numActions);
+
+	bool changed = true;
+
+	while (changed) {
+
+		//actions whose successors all remain candidates or goals
+		this->allowedActions.assign(this->numStates * this->numActions,
+				false);
+
+		for (int i = 0; i < this->numStates; ++i) {
+			for (int a = 0; a < this->numActions; ++a) {
+
+				vector<double> successors = this->transitionRow(a, i);
+				bool inside = true;
+
+				for (int j = 0; j < this->numStates && inside; ++j) {
+					inside = successors(j) == 0.0 || candidate[j];
+				}
+
+				this->allowedActions[i * this->numActions + a] = inside;
+			}
+		}
+
+		//backward breadth first search from the goals over allowed actions
+		std::vector<bool> reaches(this->goalMask);
+		std::queue<int> frontier;
+
+		this->properInitialPolicy.clear();
+
+		for (int i = 0; i < this->numStates; ++i) {
+			if (this->goalMask[i]) {
+				frontier.push(i);
+			}
+		}
+
+		while (!frontier.empty()) {
+
+			int state = frontier.front();
+			frontier.pop();
+
+			for (unsigned k = 0; k < this->predecessors[state].size(); ++k) {
+
+				int pred = this->predecessors[state][k];
+
+				if (reaches[pred] || !candidate[pred]) {
+					continue;
+				}
+
+				for (int a = 0; a < this->numActions; ++a) {
+
+					//this action moves one step closer to a goal with positive probability
+					if (this->isAllowed(pred, a)
+							&& this->transition(a, pred, state) != 0.0) {
+
+						reaches[pred] = true;
+						this->properInitialPolicy(pred, a) = 1.0;
+						frontier.push(pred);
+						break;
+					}
+				}
+			}
+		}
+
+		changed = reaches != candidate;
+		candidate = reaches;
+	}
+
+	this->properMask = candidate;
+}
+
+//sample a successor of the state from the given distribution over states
+int MDP::sampleSuccessor(const vector<double> &weights) {
+
+	double total = sum(weights);
+	double target = std::uniform_real_distribution<double>(0.0, total)(
+			this->generator);
+
+	int last = -1;
+
+	for (unsigned j = 0; j < weights.size(); ++j) {
+
+		if (weights(j) > 0.0) {
+
+			last = j;
+			target -= weights(j);
+
+			if (target < 0.0) {
+				return j;
+			}
+		}
+	}
+
+	//rounding can leave a tiny remainder after the last successor
+	return last;
+}
+
+//mark the given states as the solved set reported by isSolved
+void MDP::labelSolved(const std::vector<bool> &solved) {
+	this->coveredMask = solved;
+}
+
+//greedy backup of an RTDP trial, dead ends are worth 0
+double MDP::trialBackup(int state, const vector<double> &valueFunc,
+		int &action) {
+
+	double value = this->greedyBackup(state, valueFunc, action);
+
+	return action < 0 ? 0.0 : value;
+}
+
+//LRTDP labeling procedure
+bool MDP::checkSolved(int state, double epsilon, vector<double> &valueFunc,
+		std::vector<bool> &solved) {
+
+	bool converged = true;
+
+	std::vector<int> open;
+	std::vector<int> closed;
+	std::vector<bool> seen(this->numStates, false);
+
+	if (!solved[state]) {
+		open.push_back(state);
+		seen[state] = true;
+	}
+
+	int action;
+
+	while (!open.empty()) {
+
+		int s = open.back();
+		open.pop_back();
+		closed.push_back(s);
+
+		double value = this->trialBackup(s, valueFunc, action);
+
+		if (std::fabs(value - valueFunc(s)) > epsilon) {
+			converged = false;
+			continue;
+		}
+
+		//dead ends have no successors
+		if (action < 0) {
+			continue;
+		}
+
+		//expand the successors under the greedy action
+		vector<double> successors = this->transitionRow(action, s);
+
+		for (unsigned j = 0; j < successors.size(); ++j) {
+
+			if (successors(j) != 0.0 && !solved[j] && !seen[j]) {
+				seen[j] = true;
+				open.push_back(j);
+			}
+		}
+	}
+
+	if (converged) {
+
+		for (unsigned k = 0; k < closed.size(); ++k) {
+			solved[closed[k]] = true;
+		}
+
+	} else {
+
+		//back up the envelope in reverse order of discovery
+		while (!closed.empty()) {
+
+			int s = closed.back();
+			closed.pop_back();
+
+			valueFunc(s) = this->trialBackup(s, valueFunc, action);
+			++this->backupCount;
+		}
+	}
+
+	return converged;
+}
+
+//compute the optimal value function on the greedy envelope of the start state by labeled RTDP
+vector<double> MDP::labeledRTDP(int start, double epsilon,
+		StateHeuristic upperBound) {
+
+	vector<double> valueFunction(this->numStates);
+	std::vector<bool> solved(this->goalMask);
+
+	for (int i = 0; i < this->numStates; ++i) {
+		valueFunction(i) = this->goalMask[i] ? 0.0 : upperBound(i);
+	}
+
+	this->backupCount = 0;
+
+	int action;
+
+	while (!solved[start]) {
+
+		std::vector<int> visited;
+		int state = start;
+
+		//trials are cut at the number of states so models without goals still terminate them
+		while (!solved[state]
+				&& visited.size() < (unsigned) this->numStates) {
+
+			visited.push_back(state);
+
+			valueFunction(state) = this->trialBackup(state, valueFunction,
+					action);
+			++this->backupCount;
+
+			//a dead end ends the trial and is solved
+			if (action < 0) {
+				solved[state] = true;
+				break;
+			}
+
+			state = this->sampleSuccessor(this->transitionRow(action, state));
+		}
+
+		//label the trial's states from the end until one is not yet converged
+		while (!visited.empty()) {
+
+			state = visited.back();
+			visited.pop_back();
+
+			if (!this->checkSolved(state, epsilon, valueFunction, solved)) {
+				break;
+			}
+		}
+	}
+
+	this->labelSolved(solved);
+
+	return valueFunction;
+}
+
+//compute upper and lower bounds on the optimal value function around the start state by bounded RTDP
+vector<double> MDP::boundedRTDP(int start, double epsilon,
+		StateHeuristic upperBound, StateHeuristic lowerBound,
+		vector<double> &lowerValue, double tau) {
+
+	vector<double> upperValue(this->numStates);
+	lowerValue.resize(this->numStates);
+
+	for (int i = 0; i < this->numStates; ++i) {
+		upperValue(i) = this->goalMask[i] ? 0.0 : upperBound(i);
+		lowerValue(i) = this->goalMask[i] ? 0.0 : lowerBound(i);
+	}
+
+	this->backupCount = 0;
+
+	int action;
+	int lowerAction;
+
+	while (upperValue(start) - lowerValue(start) > epsilon) {
+
+		std::vector<int> visited;
+		int state = start;
+
+		while (!this->goalMask[state]
+				&& visited.size() < (unsigned) this->numStates) {
+
+			visited.push_back(state);
+
+			upperValue(state) = this->trialBackup(state, upperValue, action);
+			lowerValue(state) = this->trialBackup(state, lowerValue,
+					lowerAction);
+			++this->backupCount;
+
+			//a dead end ends the trial with both bounds at its value
+			if (action < 0) {
+				break;
+			}
+
+			//successors weighted by how much their bounds still disagree
+			vector<double> gap = element_prod(
+					this->transitionRow(action, state),
+					upperValue - lowerValue);
+
+			if (sum(gap) <= (upperValue(start) - lowerValue(start)) / tau) {
+				break;
+			}
+
+			state = this->sampleSuccessor(gap);
+		}
+
+		while (!visited.empty()) {
+
+			state = visited.back();
+			visited.pop_back();
+
+			upperValue(state) = this->trialBackup(state, upperValue, action);
+			lowerValue(state) = this->trialBackup(state, lowerValue,
+					lowerAction);
+			++this->backupCount;
+		}
+	}
+
+	//the states whose bounds have met are the solved envelope
+	std::vector<bool> solved(this->numStates);
+
+	for (int i = 0; i < this->numStates; ++i) {
+		solved[i] = upperValue(i) - lowerValue(i) <= epsilon;
+	}
+
+	this->labelSolved(solved);
+
+	return upperValue;
+}
+
+//maximum undiscounted action value at the state, for the average reward criterion
+double MDP::gainBackup(unsigned state, const vector<double> &bias,
+		int &bestAction, int currentAction) {
+
+	double best = -std::numeric_limits<double>::infinity();
+	bestAction = -1;
+
+	//relative tolerance under which another action does not displace the current one
+	const double tie = 1e-12;
+
+	for (int a = 0; a < this->numActions; ++a) {
+
+		double value = this->actionReward(state, a)
+				+ this->expectedValue(a, state, &bias(0));
+
+		if (value > best) {
+			best = value;
+			bestAction = a;
+		}
+	}
+
+	if (currentAction >= 0) {
+
+		double current = this->actionReward(state, currentAction)
+				+ this->expectedValue(currentAction, state, &bias(0));
+
+		if (current >= best - tie * (1.0 + std::fabs(best))) {
+			bestAction = currentAction;
+		}
+	}
+
+	return best;
+}
+
+//compute the optimal gain and bias by relative value iteration
+vector<double> MDP::relativeValueIteration(double epsilon, double &gain,
+		int referenceState, double aperiodicity) {
+
+	vector<double> bias = zero_vector<double>(this->numStates);
+	vector<double> update(this->numStates);
+
+	this->backupCount = 0;
+
+	int action;
+	double span = 10.0 + epsilon;
+
+	while (span > epsilon) {
+
+		for (int i = 0; i < this->numStates; ++i) {
+			update(i) = aperiodicity * this->gainBackup(i, bias, action)
+					+ (1.0 - aperiodicity) * bias(i);
+		}
+
+		this->backupCount += this->numStates;
+
+		//the gain lies between the smallest and largest change, their span is the stopping criterion
+		vector<double> change = update - bias;
+
+		double low = *std::min_element(change.begin(), change.end());
+		double high = *std::max_element(change.begin(), change.end());
+
+		span = high - low;
+		gain = 0.5 * (low + high) / aperiodicity;
+
+		//renormalize so the bias stays bounded
+		bias = update - scalar_vector<double>(this->numStates,
+				update(referenceState));
+	}
+
+	return bias;
+}
+
+//gain and bias of a unichain policy
+vector<double> MDP::averageRewardEvaluation(matrix<double> policyTrans,
+		vector<double> policyRew, double &gain, int referenceState) {
+
+	const unsigned n = policyRew.size();
+
+	//(I - P) h + g 1 = r, with the column of the reference state's bias (fixed at zero) standing in for g
+	matrix<double> system = identity_matrix<double>(n) - policyTrans;
+
+	for (unsigned i = 0; i < n; ++i) {
+		system(i, referenceState) = 1.0;
+	}
+
+	permutation_matrix<std::size_t> pivots(n);
+	vector<double> solution = policyRew;
+
+	if (lu_factorize(system, pivots) != 0) {
+		throw std::runtime_error(
+				"averageRewardEvaluation: policy is not unichain");
+	}
+
+	lu_substitute(system, pivots, solution);
+
+	gain = solution(referenceState);
+	solution(referenceState) = 0.0;
+
+	return solution;
+}
+
+//compute the gain optimal policy of a unichain MDP by average reward policy iteration
+matrix<double> MDP::averageRewardPolicyIteration(double &gain,
+		int referenceState) {
+
+	//start from the first action everywhere, a deterministic policy is needed for the tie rule
+	std::vector<int> actions(this->numStates, 0);
+
+	bool changed = true;
+
+	matrix<double> policy;
+
+	while (changed) {
+
+		policy = zero_matrix<double>(this->numStates, this->numActions);
+
+		for (int i = 0; i < this->numStates; ++i) {
+			policy(i, actions[i]) = 1.0;
+		}
+
+		vector<double> bias = this->averageRewardEvaluation(
+				this->policyTransitions(policy), this->policyReward(policy),
+				gain, referenceState);
+
+		changed = false;
+
+		for (int i = 0; i < this->numStates; ++i) {
+
+			int action;
+			this->gainBackup(i, bias, action, actions[i]);
+
+			if (action != actions[i]) {
+				actions[i] = action;
+				changed = true;
+			}
+		}
+	}
+
+	return policy;
+}
+
+//solve a finite horizon problem by backward induction
+std::vector<std::vector<MDP::ActionIndex> > MDP::backwardInduction(int horizon,
+		vector<double> terminalValue,
+		std::vector<vector<double> > &stageValues, int keepStages,
+		StageModel stageModel) {
+
+	if (this->numActions > noAction) {
+		throw std::range_error(
+				"backwardInduction: too many actions for an ActionIndex");
+	}
+
+	std::vector<std::vector<ActionIndex> > stagePolicy(horizon,
+			std::vector<ActionIndex>(this->numStates));
+
+	if (keepStages <= 0 || keepStages > horizon) {
+		keepStages = horizon;
+	}
+
+	//kept values are collected from the last stage backwards and reversed at the end
+	stageValues.clear();
+	stageValues.reserve(keepStages);
+
+	vector<double> next = terminalValue;
+	vector<double> current(this->numStates);
+
+	this->backupCount = 0;
+
+	for (int stage = horizon - 1; stage >= 0; --stage) {
+
+		MDP *model = stageModel ? stageModel(stage) : NULL;
+
+		if (model == NULL) {
+			model = this;
+		}
+
+		for (int i = 0; i < this->numStates; ++i) {
+
+			int action;
+
+			current(i) = model->greedyBackup(i, next, action);
+
+			if (action < 0) {
+				current(i) = 0.0;
+				stagePolicy[stage][i] = noAction;
+				continue;
+			}
+
+			stagePolicy[stage][i] = (ActionIndex) action;
+		}
+
+		this->backupCount += this->numStates;
+
+		if (stage < keepStages) {
+			stageValues.push_back(current);
+		}
+
+		next.swap(current);
+	}
+
+	std::reverse(stageValues.begin(), stageValues.end());
+
+	return stagePolicy;
+}
+
+//locality improving order of the states by reverse Cuthill-McKee on the symmetrized transition graph
+std::vector<int> MDP::reverseCuthillMcKee() {
+
+	//undirected neighbours: predecessors plus successors
+	std::vector<std::vector<int> > neighbours(this->predecessors);
+
+	for (int i = 0; i < this->numStates; ++i) {
+		for (unsigned k = 0; k < this->predecessors[i].size(); ++k) {
+			neighbours[this->predecessors[i][k]].push_back(i);
+		}
+	}
+
+	for (int i = 0; i < this->numStates; ++i) {
+
+		std::vector<int> &adjacent = neighbours[i];
+
+		std::sort(adjacent.begin(), adjacent.end());
+		adjacent.erase(std::unique(adjacent.begin(), adjacent.end()),
+				adjacent.end());
+	}
+
+	//states by increasing degree, so each component starts from a low degree (peripheral) state
+	std::vector<std::pair<std::size_t, int> > byDegree;
+
+	for (int i = 0; i < this->numStates; ++i) {
+		byDegree.push_back(std::make_pair(neighbours[i].size(), i));
+	}
+
+	std::sort(byDegree.begin(), byDegree.end());
+
+	std::vector<bool> visited(this->numStates, false);
+	std::vector<int> order;
+
+	for (unsigned s = 0; s < byDegree.size(); ++s) {
+
+		if (visited[byDegree[s].second]) {
+			continue;
+		}
+
+		//Cuthill-McKee: breadth first, unvisited neighbours in order of increasing degree
+		std::size_t head = order.size();
+
+		order.push_back(byDegree[s].second);
+		visited[byDegree[s].second] = true;
+
+		while (head < order.size()) {
+
+			int state = order[head++];
+
+			std::vector<std::pair<std::size_t, int> > next;
+
+			for (unsigned k = 0; k < neighbours[state].size(); ++k) {
+
+				int neighbour = neighbours[state][k];
+
+				if (!visited[neighbour]) {
+					visited[neighbour] = true;
+					next.push_back(
+							std::make_pair(neighbours[neighbour].size(),
+									neighbour));
+				}
+			}
+
+			std::sort(next.begin(), next.end());
+
+			for (unsigned k = 0; k < next.size(); ++k) {
+				order.push_back(next[k].second);
+			}
+		}
+	}
+
+	std::reverse(order.begin(), order.end());
+
+	return order;
+}
+
+//solve a copy of the model renumbered by reverseCuthillMcKee inside policyIteration and valueIteration
+void MDP::setStateReordering(bool enabled) {
+	this->reorderStates = enabled;
+}
+
+//copy of this MDP with its states renumbered so that new state k is old state order[k]
+MDP MDP::renumbered(const std::vector<int> &order) {
+
+	std::vector<int> position(this->numStates);
+
+	for (int k = 0; k < this->numStates; ++k) {
+		position[order[k]] = k;
+	}
+
+	//settings carry over with the copy, everything indexed by state is rebuilt
+	MDP local(*this);
+
+	local.reorderStates = false;
+	local.reorderedModel.reset();
+
+	//the copy starts its own workers when it first needs them instead of sharing this model's
+	local.workerPool.reset();
+
+	std::map<int, matrix<double> > transitions;
+
+	for (int a = 0; a < this->numActions; ++a) {
+
+		matrix<double> &permuted = transitions[a];
+		permuted.resize(this->numStates, this->numStates);
+
+		for (int k = 0; k < this->numStates; ++k) {
+
+			vector<double> original = this->transitionRow(a, order[k]);
+
+			for (int l = 0; l < this->numStates; ++l) {
+				permuted(k, l) = original(order[l]);
+			}
+		}
+	}
+
+	for (int k = 0; k < this->numStates; ++k) {
+		row(local.actionReward, k) = row(this->actionReward, order[k]);
+		local.goalMask[k] = this->goalMask[order[k]];
+	}
+
+	for (unsigned k = 0; k < local.initialStates.size(); ++k) {
+		local.initialStates[k] = position[this->initialStates[k]];
+	}
+
+	local.solveStates.clear();
+	local.solvedMask.clear();
+	local.coveredMask.clear();
+	local.cachedOptimalPolicy.resize(0, 0);
+	local.factoredTransitions.resize(0, 0);
+	local.inverseColumns.clear();
+
+	local.setTransitions(transitions);
+
+	if (local.shortestPath) {
+		local.findProperStates();
+	}
+
+	return local;
+}
+
+//the cached renumbered copy with this model's current solver settings
+MDP &MDP::reordered() {
+
+	if (!this->reorderedModel) {
+		this->reorderedOrder = this->reverseCuthillMcKee();
+		this->reorderedModel = std::make_shared<MDP>(
+				this->renumbered(this->reorderedOrder));
+	}
+
+	MDP &local = *this->reorderedModel;
+
+	local.evaluationScheme = this->evaluationScheme;
+	local.evaluationTolerance = this->evaluationTolerance;
+	local.inexactPolicyIteration = this->inexactPolicyIteration;
+	local.andersonDepth = this->andersonDepth;
+	local.relaxation = this->relaxation;
+	local.maxUpdateRank = this->maxUpdateRank;
+	local.tileSize = this->tileSize;
+	local.tileSteps = this->tileSteps;
+	local.threadCount = this->threadCount;
+	local.numaPlacement = this->numaPlacement;
+	local.reproducible = this->reproducible;
+	local.chunkWork = this->chunkWork;
+
+	if (local.hugePages != this->hugePages) {
+		local.setHugePageBacking(this->hugePages);
+	}
+
+	return local;
+}
+
+//take the backup count and the solved states of the renumbered copy's last solve
+void MDP::takeReorderedResults() {
+
+	const MDP &local = *this->reorderedModel;
+
+	this->backupCount = local.backupCount;
+	this->coveredMask.clear();
+
+	if (!local.coveredMask.empty()) {
+
+		this->coveredMask.resize(this->numStates);
+
+		for (int k = 0; k < this->numStates; ++k) {
+			this->coveredMask[this->reorderedOrder[k]] = local.coveredMask[k];
+		}
+	}
+}
+
+//policy of the renumbered copy in this model's numbering
+matrix<double> MDP::fromReordered(const matrix<double> &localPolicy) {
+
+	matrix<double> policy(this->numStates, this->numActions);
+
+	for (int k = 0; k < this->numStates; ++k) {
+		row(policy, this->reorderedOrder[k]) = row(localPolicy, k);
+	}
+
+	return policy;
+}
+
+//worker threads used by the parallel solvers
+void MDP::setThreadCount(int threads) {
+	this->threadCount = threads;
+}
+
+//NUMA placement of the parallel solvers' workers and data
+void MDP::setNumaPlacement(bool enabled) {
+	this->numaPlacement = enabled;
+}
+
+//fixed order reductions in this model's backups and sums
+void MDP::setReproducibleReductions(bool enabled) {
+	this->reproducible = enabled;
+}
+
+//transparent huge page backing of the transition rows and the parallel solvers' arrays
+void MDP::setHugePageBacking(bool enabled) {
+
+	this->hugePages = enabled;
+
+	//move the rows to memory allocated with the new advice
+	std::vector<double, AlignedAllocator<double> >(
+			this->paddedTransitions.begin(), this->paddedTransitions.end(),
+			AlignedAllocator<double>(enabled)).swap(this->paddedTransitions);
+}
+
+//number of worker threads the parallel solvers start
+int MDP::workerCount() {
+
+	if (this->threadCount > 0) {
+		return this->threadCount;
+	}
+
+	std::vector<NumaNode> nodes = numaTopology();
+	int cpus = 0;
+
+	for (unsigned k = 0; k < nodes.size(); ++k) {
+		cpus += nodes[k].cpus.size();
+	}
+
+	return std::max(cpus, 1);
+}
+
+//CPU each of the given number of workers is pinned to
+std::vector<int> MDP::workerCpus(int threads) {
+
+	//without NUMA placement the workers float
+	if (!this->numaPlacement) {
+		return std::vector<int>(threads, -1);
+	}
+
+	//usable CPUs node by node, so consecutive workers share a node
+	std::vector<NumaNode> nodes = numaTopology();
+	std::vector<int> ordered;
+
+	for (unsigned k = 0; k < nodes.size(); ++k) {
+		ordered.insert(ordered.end(), nodes[k].cpus.begin(),
+				nodes[k].cpus.end());
+	}
+
+	//workers spread over the CPUs in proportion to each node's share of them
+	std::vector<int> cpus(threads);
+
+	for (int t = 0; t < threads; ++t) {
+		cpus[t] = ordered[(long) t * ordered.size() / threads];
+	}
+
+	return cpus;
+}
+
+//the persistent worker pool, restarted only when the thread count or placement changed
+WorkerPool &MDP::workers() {
+
+	std::vector<int> cpus = this->workerCpus(this->workerCount());
+
+	if (!this->workerPool || this->workerPool->workerCpus() != cpus) {
+		this->workerPool = std::make_shared<WorkerPool>(cpus);
+	}
+
+	return *this->workerPool;
+}
+
+//target number of transition nonzeros per chunk of the parallel solvers
+void MDP::setChunkSize(int nonzeros) {
+	this->chunkWork = nonzeros;
+}
+
+//split the states into chunks of similar transition nonzero counts and give each worker a contiguous range
+//of chunks holding a similar share of the nonzeros
+void MDP::partitionChunks(int threads, const std::vector<int> &order,
+		std::vector<int> &chunkStart, std::vector<int> &firstChunk) {
+
+	const int count = order.empty() ? this->numStates : order.size();
+
+	//work of a backup is the number of successor entries it reads over every action
+	std::vector<long> work(count);
+	long total = 0;
+
+	for (int p = 0; p < count; ++p) {
+
+		const int i = order.empty() ? p : order[p];
+
+		if (this->useSparseRows) {
+
+			work[p] = 0;
+
+			for (std::map<int, sparseRows>::iterator it =
+					this->sparseTransitions.begin();
+					it != this->sparseTransitions.end(); ++it) {
+				work[p] += it->second.rowStart[i + 1] - it->second.rowStart[i];
+			}
+		} else {
+			work[p] = (long) this->numActions * this->numStates;
+		}
+
+		//the action loop costs something even for rows without successors
+		work[p] += this->numActions;
+		total += work[p];
+	}
+
+	//enough chunks per worker to even out the skew by stealing
+	const int chunksPerWorker = 8;
+
+	long target =
+			this->chunkWork > 0 ?
+					this->chunkWork :
+					std::max(total / ((long) threads * chunksPerWorker), 1L);
+
+	//chunks close once they reach the target, so a state heavier than the target is a chunk of its own
+	chunkStart.assign(1, 0);
+	std::vector<long> chunkEndWork;
+	long accumulated = 0;
+	long open = 0;
+
+	for (int p = 0; p < count; ++p) {
+
+		open += work[p];
+		accumulated += work[p];
+
+		if (open >= target || p == count - 1) {
+			chunkStart.push_back(p + 1);
+			chunkEndWork.push_back(accumulated);
+			open = 0;
+		}
+	}
+
+	//worker t owns the chunks ending in the t-th share of the work
+	const int chunks = chunkStart.size() - 1;
+
+	firstChunk.assign(threads + 1, chunks);
+	firstChunk[0] = 0;
+
+	int chunk = 0;
+
+	for (int t = 1; t < threads; ++t) {
+
+		while (chunk < chunks
+				&& chunkEndWork[chunk] * threads <= total * t) {
+			++chunk;
+		}
+
+		firstChunk[t] = chunk;
+	}
+}
+
+//whether the parallel solvers copy the transition rows to the node of the worker sweeping them
+bool MDP::nodeLocalRows() {
+	return this->numaPlacement && numaTopology().size() > 1;
+}
+
+//copy the rewards and masks of states begin to end - 1, and their transition rows if asked to
+void MDP::copyStateRows(int begin, int end, bool copyRows, stateRows &rows) {
+
+	const int count = end - begin;
+	const int numActions = this->numActions;
+
+	rows.begin = begin;
+	rows.copied = copyRows;
+	rows.rewards.resize(count * numActions);
+	rows.allowed.resize(count * numActions);
+	rows.solved.resize(count);
+	rows.rowStart.assign(1, 0);
+	rows.denseRows = std::vector<double, AlignedAllocator<double> >(
+			AlignedAllocator<double>(this->hugePages));
+
+	for (int k = 0; k < count; ++k) {
+
+		rows.solved[k] = this->inSolveSet(begin + k);
+
+		for (int a = 0; a < numActions; ++a) {
+
+			rows.rewards[k * numActions + a] = this->actionReward(begin + k, a);
+			rows.allowed[k * numActions + a] = this->isAllowed(begin + k, a);
+
+			if (!copyRows) {
+				continue;
+			}
+
+			if (this->useSparseRows) {
+
+				const sparseRows &sparse =
+						this->sparseTransitions.find(a)->second;
+
+				rows.values.insert(rows.values.end(),
+						sparse.values.begin() + sparse.rowStart[begin + k],
+						sparse.values.begin() + sparse.rowStart[begin + k + 1]);
+				rows.columns.insert(rows.columns.end(),
+						sparse.columns.begin() + sparse.rowStart[begin + k],
+						sparse.columns.begin()
+								+ sparse.rowStart[begin + k + 1]);
+				rows.rowStart.push_back(rows.values.size());
+			} else {
+
+				const double *row = this->paddedRow(a, begin + k);
+
+				rows.denseRows.insert(rows.denseRows.end(), row,
+						row + this->rowStride);
+			}
+		}
+	}
+}
+
+//greedy backup of state rows.begin + k from its private rows
+double MDP::rowsBackup(const stateRows &rows, int k, const double *valueFunc,
+		int &bestAction) {
+
+	const int numActions = this->numActions;
+
+	//the Q(s,.) block lives on the stack for the usual small action sets
+	const int stackActions = 16;
+
+	double stackValues[stackActions];
+	std::vector<double> heapValues;
+	double *values = stackValues;
+
+	if (numActions > stackActions) {
+		heapValues.resize(numActions);
+		values = &heapValues[0];
+	}
+
+	for (int a = 0; a < numActions; ++a) {
+
+		const int row = k * numActions + a;
+
+		double expected;
+
+		if (!rows.copied) {
+			expected = this->expectedValue(a, rows.begin + k, valueFunc);
+		} else if (this->useSparseRows) {
+			expected = sparseDot(rows.values.data() + rows.rowStart[row],
+					rows.columns.data() + rows.rowStart[row],
+					rows.rowStart[row + 1] - rows.rowStart[row], valueFunc,
+					this->reproducible);
+		} else {
+			expected = denseDot(
+					rows.denseRows.data() + (std::size_t) row * this->rowStride,
+					valueFunc, this->numStates, this->reproducible);
+		}
+
+		values[a] =
+				rows.allowed[row] ?
+						rows.rewards[row] + this->discount * expected :
+						-std::numeric_limits<double>::infinity();
+	}
+
+	double best;
+	bestAction = argmaxValue(values, numActions, best);
+
+	return best;
+}
+
+//greedy backup of state rows.begin + k from its private rows, reading a value function shared with concurrent writers
+double MDP::rowsBackup(const stateRows &rows, int k,
+		const std::atomic<double> *valueFunc, int &bestAction) {
+
+	const int numActions = this->numActions;
+
+	//the Q(s,.) block lives on the stack for the usual small action sets
+	const int stackActions = 16;
+
+	double stackValues[stackActions];
+	std::vector<double> heapValues;
+	double *values = stackValues;
+
+	if (numActions > stackActions) {
+		heapValues.resize(numActions);
+		values = &heapValues[0];
+	}
+
+	//atomic loads cannot go through the vector kernels, relaxed ones still compile to plain loads
+	for (int a = 0; a < numActions; ++a) {
+
+		const int row = k * numActions + a;
+		double expected = 0.0;
+
+		if (this->useSparseRows) {
+
+			const double *values;
+			const int *columns;
+			int first;
+			int last;
+
+			if (rows.copied) {
+
+				values = rows.values.data();
+				columns = rows.columns.data();
+				first = rows.rowStart[row];
+				last = rows.rowStart[row + 1];
+
+			} else {
+
+				const sparseRows &sparse = this->sparseTransitions.find(a)->second;
+
+				values = sparse.values.data();
+				columns = sparse.columns.data();
+				first = sparse.rowStart[rows.begin + k];
+				last = sparse.rowStart[rows.begin + k + 1];
+			}
+
+			for (int e = first; e < last; ++e) {
+				expected += values[e]
+						* valueFunc[columns[e]].load(std::memory_order_relaxed);
+			}
+		} else {
+
+			const double *transRow =
+					rows.copied ?
+							rows.denseRows.data()
+									+ (std::size_t) row * this->rowStride :
+							this->paddedRow(a, rows.begin + k);
+
+			for (int j = 0; j < this->numStates; ++j) {
+				expected += transRow[j]
+						* valueFunc[j].load(std::memory_order_relaxed);
+			}
+		}
+
+		values[a] =
+				rows.allowed[row] ?
+						rows.rewards[row] + this->discount * expected :
+						-std::numeric_limits<double>::infinity();
+	}
+
+	double best;
+	bestAction = argmaxValue(values, numActions, best);
+
+	return best;
+}
+
+//compute the optimal value function by parallel synchronous value iteration
+vector<double> MDP::parallelValueIteration(double epsilon) {
+
+	const int n = this->numStates;
+
+	std::vector<int> colors;
+
+	if (this->evaluationScheme == COLORED) {
+		colors = this->stateColoring();
+	}
+
+	//too many colors for the barriers to pay off runs the Jacobi sweeps below
+	if (!colors.empty()
+			&& *std::max_element(colors.begin(), colors.end()) < maxColors) {
+
+		vector<double> valueFunction = zero_vector<double>(n);
+
+		//states of one color are written concurrently, so a backup must not even load a state it has no
+		//transition to, as a dense row would
+		std::map<int, sparseRows> scratch;
+		const std::map<int, sparseRows> &rows = this->compressedTransitions(
+				scratch);
+
+		this->backupCount = n
+				* this->coloredSweeps(colors, epsilon,
+						[&](int i) {
+
+							if (!this->inSolveSet(i)) {
+								return 0.0;
+							}
+
+							int action;
+							double updated = this->compressedBackup(rows, i, valueFunction, action);
+							double change = std::fabs(updated - valueFunction(i));
+
+							valueFunction(i) = updated;
+
+							return change;
+						});
+
+		return valueFunction;
+	}
+
+	WorkerPool &pool = this->workers();
+	const int threads = pool.size();
+
+	std::vector<int> chunkStart;
+	std::vector<int> firstChunk;
+
+	this->partitionChunks(threads, std::vector<int>(), chunkStart, firstChunk);
+
+	//private rows of every chunk, each allocated and first touched by the worker owning the chunk
+	std::vector<stateRows> chunkRows(chunkStart.size() - 1);
+	const bool copyRows = this->nodeLocalRows();
+
+	//the iterates are not initialized here, each owner's first write places its slices on its own node
+	AlignedAllocator<double> allocator(this->hugePages);
+	double *current = allocator.allocate(n);
+	double *next = allocator.allocate(n);
+	double *result = current;
+
+	//largest change over the states each worker backed up, double buffered by sweep parity so that a worker
+	//starting the next sweep cannot overwrite a residual another worker is still reading
+	std::vector<double> residuals(2 * threads, 0.0);
+	long sweeps = 0;
+
+	SweepBarrier barrier(threads);
+	StealingScheduler scheduler(threads);
+
+	for (int t = 0; t < threads; ++t) {
+		scheduler.refill(t, 0, firstChunk[t], firstChunk[t + 1]);
+	}
+
+	pool.run([&](int t) {
+
+		for (int c = firstChunk[t]; c < firstChunk[t + 1]; ++c) {
+
+			this->copyStateRows(chunkStart[c], chunkStart[c + 1], copyRows,
+					chunkRows[c]);
+
+			std::fill(current + chunkStart[c], current + chunkStart[c + 1], 0.0);
+			std::fill(next + chunkStart[c], next + chunkStart[c + 1], 0.0);
+		}
+
+		//every slice is placed before any worker reads it
+		barrier.wait();
+
+		double *source = current;
+		double *target = next;
+		int action;
+		int c;
+
+		for (long sweep = 0;; ++sweep) {
+
+			double delta = 0.0;
+
+			while (scheduler.next(t, sweep, c)) {
+
+				const stateRows &rows = chunkRows[c];
+
+				for (int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+
+					if (!rows.solved[i - rows.begin]) {
+						continue;
+					}
+
+					double best = this->rowsBackup(rows, i - rows.begin, source,
+							action);
+
+					delta = std::max(delta, std::fabs(best - source[i]));
+					target[i] = best;
+				}
+			}
+
+			residuals[(sweep % 2) * threads + t] = delta;
+
+			//this worker's range for the next sweep, which nobody reads until after the barrier
+			scheduler.refill(t, sweep + 1, firstChunk[t], firstChunk[t + 1]);
+
+			barrier.wait();
+
+			double largest = 0.0;
+
+			for (int u = 0; u < threads; ++u) {
+				largest = std::max(largest, residuals[(sweep % 2) * threads + u]);
+			}
+
+			std::swap(source, target);
+
+			if (largest <= epsilon) {
+
+				if (t == 0) {
+					sweeps = sweep + 1;
+					result = source;
+				}
+
+				break;
+			}
+		}
+	});
+
+	vector<double> valueFunction(n);
+	std::copy(result, result + n, valueFunction.begin());
+
+	allocator.deallocate(current, n);
+	allocator.deallocate(next, n);
+
+	this->backupCount = sweeps * n;
+
+	return valueFunction;
+}
+
+//Greedy policy improvement on the parallel workers
+matrix<double> MDP::parallelPolicyImprovement(vector<double> valueFunction) {
+
+	matrix<double> greedyPolicy = zero_matrix<double>(this->numStates,
+			this->numActions);
+
+	WorkerPool &pool = this->workers();
+	const int threads = pool.size();
+
+	std::vector<int> chunkStart;
+	std::vector<int> firstChunk;
+
+	this->partitionChunks(threads, std::vector<int>(), chunkStart, firstChunk);
+
+	StealingScheduler scheduler(threads);
+
+	for (int t = 0; t < threads; ++t) {
+		scheduler.refill(t, 0, firstChunk[t], firstChunk[t + 1]);
+	}
+
+	//each state's row of the policy is written by exactly one worker
+	pool.run([&](int t) {
+
+		int action;
+		int c;
+
+		while (scheduler.next(t, 0, c)) {
+			for (int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+
+				//unreachable states are left without an action
+				if (!this->inSolveSet(i)) {
+					continue;
+				}
+
+				this->greedyBackup(i, valueFunction, action);
+
+				if (action >= 0) {
+					greedyPolicy(i, action) = 1.0;
+				}
+			}
+		}
+	});
+
+	return greedyPolicy;
+}
+
+//first fit coloring of an undirected graph in index order, so that no two neighbours share a color
+static std::vector<int> colorGraph(
+		const std::vector<std::vector<int> > &neighbours) {
+
+	const int n = neighbours.size();
+
+	std::vector<int> colors(n, -1);
+
+	//usedBy[c] == i when color c is taken by a neighbour of state i
+	std::vector<int> usedBy;
+
+	for (int i = 0; i < n; ++i) {
+
+		for (unsigned k = 0; k < neighbours[i].size(); ++k) {
+
+			int color = colors[neighbours[i][k]];
+
+			if (color >= 0) {
+				usedBy[color] = i;
+			}
+		}
+
+		int color = 0;
+
+		while (color < (int) usedBy.size() && usedBy[color] == i) {
+			++color;
+		}
+
+		if (color == (int) usedBy.size()) {
+			usedBy.push_back(-1);
+		}
+
+		colors[i] = color;
+	}
+
+	return colors;
+}
+
+//the model's compressed sparse rows, or scratch filled from the dense rows
+const std::map<int, MDP::sparseRows> &MDP::compressedTransitions(
+		std::map<int, sparseRows> &scratch) {
+
+	if (this->useSparseRows) {
+		return this->sparseTransitions;
+	}
+
+	for (int a = 0; a < this->numActions; ++a) {
+
+		sparseRows &sparse = scratch[a];
+
+		sparse.rowStart.assign(1, 0);
+
+		for (int i = 0; i < this->numStates; ++i) {
+
+			const double *row = this->paddedRow(a, i);
+
+			for (int j = 0; j < this->numStates; ++j) {
+				if (row[j] != 0.0) {
+					sparse.values.push_back(row[j]);
+					sparse.columns.push_back(j);
+				}
+			}
+
+			sparse.rowStart.push_back(sparse.values.size());
+		}
+	}
+
+	return scratch;
+}
+
+//greedy backup of the state reading only the nonzeros of the given rows
+double MDP::compressedBackup(const std::map<int, sparseRows> &rows,
+		unsigned state, const vector<double> &valueFunc, int &bestAction) {
+
+	double best = -std::numeric_limits<double>::infinity();
+	bestAction = -1;
+
+	for (std::map<int, sparseRows>::const_iterator it = rows.begin();
+			it != rows.end(); ++it) {
+
+		if (!this->allowedActions.empty() && !this->isAllowed(state, it->first)) {
+			continue;
+		}
+
+		const int begin = it->second.rowStart[state];
+
+		double value = this->actionReward(state, it->first)
+				+ this->discount
+						* sparseDot(it->second.values.data() + begin,
+								it->second.columns.data() + begin,
+								it->second.rowStart[state + 1] - begin,
+								&valueFunc(0), this->reproducible);
+
+		if (value > best) {
+			best = value;
+			bestAction = it->first;
+		}
+	}
+
+	return best;
+}
+
+//color of each state, such that no action moves between two distinct states of the same color
+std::vector<int> MDP::stateColoring() {
+
+	std::vector<std::vector<int> > neighbours(this->numStates);
+
+	std::map<int, sparseRows> scratch;
+	const std::map<int, sparseRows> &rows = this->compressedTransitions(
+			scratch);
+
+	for (std::map<int, sparseRows>::const_iterator it = rows.begin();
+			it != rows.end(); ++it) {
+
+		for (int i = 0; i < this->numStates; ++i) {
+			for (int k = it->second.rowStart[i]; k < it->second.rowStart[i + 1];
+					++k) {
+
+				int j = it->second.columns[k];
+
+				if (j != i) {
+					neighbours[i].push_back(j);
+					neighbours[j].push_back(i);
+				}
+			}
+		}
+	}
+
+	return colorGraph(neighbours);
+}
+
+//in-place sweeps over the color classes on the parallel workers
+long MDP::coloredSweeps(const std::vector<int> &colors, double epsilon,
+		const std::function<double(int)> &update) {
+
+	if (colors.empty()) {
+		return 0;
+	}
+
+	const int numColors = *std::max_element(colors.begin(), colors.end())
+			+ 1;
+
+	WorkerPool &pool = this->workers();
+	const int threads = pool.size();
+
+	//states of each color, chunked for the workers
+	std::vector<std::vector<int> > classes(numColors);
+
+	for (unsigned i = 0; i < colors.size(); ++i) {
+		classes[colors[i]].push_back(i);
+	}
+
+	std::vector<std::vector<int> > chunkStart(numColors);
+	std::vector<std::vector<int> > firstChunk(numColors);
+
+	for (int color = 0; color < numColors; ++color) {
+		this->partitionChunks(threads, classes[color], chunkStart[color],
+				firstChunk[color]);
+	}
+
+	//largest change over the states each worker updated in a sweep, double buffered by sweep parity
+	std::vector<double> residuals(2 * threads, 0.0);
+	long sweeps = 0;
+
+	SweepBarrier barrier(threads);
+	StealingScheduler scheduler(threads);
+
+	for (int t = 0; t < threads; ++t) {
+		scheduler.refill(t, 0, firstChunk[0][t], firstChunk[0][t + 1]);
+	}
+
+	//each color is a round of the scheduler; states of one color never read each other, so they may be
+	//updated in place concurrently, and the barrier after each color publishes its values to the next
+	pool.run([&](int t) {
+
+		int chunk;
+
+		for (long sweep = 0;; ++sweep) {
+
+			double delta = 0.0;
+
+			for (int color = 0; color < numColors; ++color) {
+
+				const long round = sweep * numColors + color;
+				const std::vector<int> &states = classes[color];
+
+				while (scheduler.next(t, round, chunk)) {
+					for (int p = chunkStart[color][chunk];
+							p < chunkStart[color][chunk + 1]; ++p) {
+						delta = std::max(delta, update(states[p]));
+					}
+				}
+
+				//this worker's range of the next color, which nobody reads until after the barrier
+				const int following = (color + 1) % numColors;
+
+				scheduler.refill(t, round + 1, firstChunk[following][t],
+						firstChunk[following][t + 1]);
+
+				if (color == numColors - 1) {
+					residuals[(sweep % 2) * threads + t] = delta;
+				}
+
+				barrier.wait();
+			}
+
+			double largest = 0.0;
+
+			for (int u = 0; u < threads; ++u) {
+				largest = std::max(largest, residuals[(sweep % 2) * threads + u]);
+			}
+
+			if (largest <= epsilon) {
+
+				if (t == 0) {
+					sweeps = sweep + 1;
+				}
+
+				break;
+			}
+		}
+	});
+
+	return sweeps;
+}
+
+//Compute the value function of a policy by multi-color Gauss-Seidel sweeps on the parallel workers
+vector<double> MDP::coloredPolicyEvaluation(const matrix<double> &pTransProb,
+		const vector<double> &pReward, double epsilon) {
+
+	const int n = pReward.size();
+
+	//the policy's own dependency graph is sparser than the model's, so it usually needs fewer colors
+	std::vector<std::vector<int> > neighbours(n);
+
+	//compressed rows of the policy, so that a backup only loads the states it has a transition to and never
+	//the states of its own color that other workers are writing
+	std::vector<double> values;
+	std::vector<int> columns;
+	std::vector<int> rowStart(1, 0);
+
+	for (int i = 0; i < n; ++i) {
+
+		for (int j = 0; j < n; ++j) {
+
+			if (pTransProb(i, j) != 0.0) {
+
+				values.push_back(pTransProb(i, j));
+				columns.push_back(j);
+
+				if (j != i) {
+					neighbours[i].push_back(j);
+					neighbours[j].push_back(i);
+				}
+			}
+		}
+
+		rowStart.push_back(values.size());
+	}
+
+	std::vector<int> colors = colorGraph(neighbours);
+
+	if (n == 0 || *std::max_element(colors.begin(), colors.end()) >= maxColors) {
+		return this->jacobiPolicyEvaluation(pTransProb, pReward, epsilon);
+	}
+
+	vector<double> valueFunction = zero_vector<double>(n);
+
+	this->backupCount = n
+			* this->coloredSweeps(colors, epsilon,
+					[&](int i) {
+
+						if (!this->inSolveSet(i)) {
+							return 0.0;
+						}
+
+						double updated = pReward(i)
+								+ this->discount
+										* sparseDot(values.data() + rowStart[i],
+												columns.data() + rowStart[i],
+												rowStart[i + 1] - rowStart[i],
+												&valueFunction(0),
+												this->reproducible);
+						double change = std::fabs(updated - valueFunction(i));
+
+						valueFunction(i) = updated;
+
+						return change;
+					});
+
+	return valueFunction;
+}
+
+//compute the optimal value function by lock-free asynchronous value iteration
+vector<double> MDP::asynchronousValueIteration(double epsilon) {
+
+	//the result of asynchronous updates depends on their order
+	if (this->reproducible) {
+		return this->parallelValueIteration(epsilon);
+	}
+
+	const int n = this->numStates;
+
+	WorkerPool &pool = this->workers();
+	const int threads = pool.size();
+
+	std::vector<int> chunkStart;
+	std::vector<int> firstChunk;
+
+	this->partitionChunks(threads, std::vector<int>(), chunkStart, firstChunk);
+
+	std::vector<stateRows> chunkRows(chunkStart.size() - 1);
+	const bool copyRows = this->nodeLocalRows();
+
+	//the shared iterate is constructed by the owners of its entries, so each slice is first touched on its own node
+	AlignedAllocator<std::atomic<double> > allocator(this->hugePages);
+	std::atomic<double> *valueFunction = allocator.allocate(n);
+
+	//passes each worker completed, and how many of them had a change above epsilon, one cache line each
+	struct alignas(64) workerProgress {
+		std::atomic<long> passes;
+		std::atomic<long> largePasses;
+		long backups;
+	};
+
+	std::vector<workerProgress> progress(threads);
+
+	for (int t = 0; t < threads; ++t) {
+		progress[t].passes = 0;
+		progress[t].largePasses = 0;
+		progress[t].backups = 0;
+	}
+
+	std::atomic<bool> converged(false);
+	SweepBarrier barrier(threads);
+
+	pool.run([&](int t) {
+
+		for (int c = firstChunk[t]; c < firstChunk[t + 1]; ++c) {
+
+			this->copyStateRows(chunkStart[c], chunkStart[c + 1], copyRows,
+					chunkRows[c]);
+
+			for (int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+				new (&valueFunction[i]) std::atomic<double>(0.0);
+			}
+		}
+
+		//the only barrier: every entry exists before any worker reads it
+		barrier.wait();
+
+		//progress of every worker when the detector last started watching for a quiet period (worker 0 only)
+		std::vector<long> passesSeen;
+		std::vector<long> largePassesSeen;
+		int action;
+
+		while (!converged.load(std::memory_order_relaxed)) {
+
+			double delta = 0.0;
+
+			for (int c = firstChunk[t]; c < firstChunk[t + 1]; ++c) {
+
+				const stateRows &rows = chunkRows[c];
+
+				for (int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+
+					if (!rows.solved[i - rows.begin]) {
+						continue;
+					}
+
+					double updated = this->rowsBackup(rows, i - rows.begin,
+							valueFunction, action);
+					double previous = valueFunction[i].load(
+							std::memory_order_relaxed);
+
+					delta = std::max(delta, std::fabs(updated - previous));
+					valueFunction[i].store(updated, std::memory_order_relaxed);
+
+					++progress[t].backups;
+				}
+			}
+
+			if (delta > epsilon) {
+				progress[t].largePasses.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			progress[t].passes.fetch_add(1, std::memory_order_release);
+
+			if (firstChunk[t] == firstChunk[t + 1]) {
+				std::this_thread::yield();
+			}
+
+			if (t != 0) {
+				continue;
+			}
+
+			//converged once every worker has completed a whole pass begun after the detector started watching,
+			//and no worker had a change above epsilon in the meantime; any such change restarts the watch
+			bool quiet = !passesSeen.empty();
+			bool complete = !passesSeen.empty();
+
+			for (int u = 0; u < threads && quiet; ++u) {
+
+				long passes = progress[u].passes.load(std::memory_order_acquire);
+
+				quiet = progress[u].largePasses.load(std::memory_order_relaxed)
+						== largePassesSeen[u];
+				complete = complete && passes >= passesSeen[u] + 2;
+			}
+
+			if (quiet && complete) {
+				converged.store(true, std::memory_order_relaxed);
+			} else if (!quiet) {
+
+				passesSeen.resize(threads);
+				largePassesSeen.resize(threads);
+
+				for (int u = 0; u < threads; ++u) {
+					passesSeen[u] = progress[u].passes.load(
+							std::memory_order_acquire);
+					largePassesSeen[u] = progress[u].largePasses.load(
+							std::memory_order_relaxed);
+				}
+			}
+		}
+	});
+
+	vector<double> values(n);
+
+	this->backupCount = 0;
+
+	for (int i = 0; i < n; ++i) {
+		values(i) = valueFunction[i].load(std::memory_order_relaxed);
+	}
+
+	for (int t = 0; t < threads; ++t) {
+		this->backupCount += progress[t].backups;
+	}
+
+	allocator.deallocate(valueFunction, n);
+
+	return values;
 }
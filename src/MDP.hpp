@@ -11,17 +11,67 @@
 #define MDP_HPP_
 
 #include <boost/numeric/ublas/matrix.hpp>
+#include <boost/numeric/ublas/lu.hpp>
 #include<map>
+#include<vector>
+#include<random>
+#include<functional>
+#include<memory>
+#include<atomic>
+#include<limits>
+#include "AlignedAllocator.hpp"
+
+class WorkerPool;
 
 using namespace boost::numeric::ublas;
 
 
 class MDP{
 
-private :
-	//mapping from action to probability transition matrix
-	std::map<int,matrix<double> > actionTransitions;
+public :
+
+	//iteration schemes used by policyEvaluation (valueIteration supports JACOBI and ANDERSON,
+	//parallelValueIteration JACOBI and COLORED)
+	enum EvaluationScheme {
+		//synchronous sweeps over every state
+		JACOBI,
+		//synchronous sweeps restricted to states whose successors changed non-negligibly
+		ACTIVE_SET,
+		//Anderson accelerated sweeps, falling back to a plain sweep when the residual grows
+		ANDERSON,
+		//in-place successive over-relaxation sweeps
+		SOR,
+		//Nesterov style momentum on top of synchronous sweeps, restarted when the residual grows
+		MOMENTUM,
+		//aggregation multigrid V-cycles with Jacobi smoothing and coarse aggregated MDP corrections
+		MULTIGRID,
+		//exact solves from a cached factorization, with low rank updates for the rows that changed since
+		INCREMENTAL,
+		//cache blocked sweeps: each tile of rows is streamed once and then relaxed several times on its
+		//diagonal block while that block is in cache
+		BLOCKED,
+		//multi-color Gauss-Seidel: in-place sweeps one color class at a time, the states of a class updated
+		//in parallel since none of them depends on another. Models needing more than 32 colors (dense ones
+		//need about one per state) are swept by JACOBI instead
+		COLORED
+	};
+
+	//fixed point operator iterated by the accelerated solvers
+	typedef std::function<vector<double>(const vector<double> &)> FixedPointMap;
+
+	//compact action index stored per state and stage by the finite horizon solver
+	typedef unsigned short ActionIndex;
 
+	//ActionIndex of a state with no allowed action, so at most noAction actions can be stored
+	static const ActionIndex noAction = std::numeric_limits<ActionIndex>::max();
+
+	//model (transitions and rewards) in effect at a stage of a finite horizon problem, or null for this MDP's own
+	typedef std::function<MDP *(int)> StageModel;
+
+	//per-state heuristic bound used to initialize the real-time dynamic programming solvers
+	typedef std::function<double(int)> StateHeuristic;
+
+private :
 	//matrix where entry (i,j) is the reward associated with taking action j from state j
 	matrix<double> actionReward;
 
@@ -34,6 +84,324 @@ private :
 	//Total number of actions in MDP
 	int numActions;
 
+	//for each state, the states that reach it with nonzero probability under some action (built once at construction)
+	std::vector<std::vector<int> > predecessors;
+
+	//number of single-state Bellman backups performed by the most recent solver call
+	long backupCount;
+
+	//compressed sparse row form of a transition matrix
+	struct sparseRows {
+		std::vector<double> values;
+		std::vector<int> columns;
+		std::vector<int> rowStart;
+	};
+
+	//the model holds one copy of the transitions: sparseTransitions when the model is sparse enough, otherwise
+	//paddedTransitions. Everything else reads them through transition, transitionRow and expectedValue
+
+	//action transition matrices in compressed sparse rows (empty when backups use dense rows)
+	std::map<int, sparseRows> sparseTransitions;
+
+	//whether the transitions are held as sparseTransitions rather than as dense rows
+	bool useSparseRows;
+
+	//dense action transition rows, packed action by action with every row padded to a whole number of
+	//cache lines so each starts 64-byte aligned (empty when backups use sparse rows)
+	std::vector<double, AlignedAllocator<double> > paddedTransitions;
+
+	//distance in doubles between consecutive rows of paddedTransitions
+	std::size_t rowStride;
+
+	//whether paddedTransitions and the parallel solvers' private rows and iterates are advised to use
+	//transparent huge pages
+	bool hugePages;
+
+	//store the given action transition matrices in whichever form the backups use and build the predecessors
+	void setTransitions(const std::map<int, matrix<double> > &at);
+
+	//start of the padded dense row of the given action and state
+	const double *paddedRow(int action, unsigned state);
+
+	//probability that the action moves the state to the successor
+	double transition(int action, unsigned state, unsigned successor);
+
+	//transition probabilities of the action from the state to every state
+	vector<double> transitionRow(int action, unsigned state);
+
+	//expected value P(s,a,.) . valueFunc of the action's successors of the state
+	double expectedValue(int action, unsigned state, const double *valueFunc);
+
+	//iteration scheme used by policyEvaluation
+	EvaluationScheme evaluationScheme;
+
+	//tolerance policyIteration evaluates its policies to (the final tolerance in inexact mode)
+	double evaluationTolerance;
+
+	//whether policyIteration loosens its evaluation tolerance while the policy is far from optimal
+	bool inexactPolicyIteration;
+
+	//number of previous iterates mixed by Anderson acceleration
+	int andersonDepth;
+
+	//iterate the map from zero until the infinity norm of its residual is below epsilon, with Anderson acceleration
+	vector<double> andersonIteration(FixedPointMap map, unsigned size,
+			double epsilon);
+
+	//SOR relaxation factor in (0,2), or 0 to estimate it from the first sweeps
+	double relaxation;
+
+	//Compute the value function of a policy by successive over-relaxation
+	vector<double> sorPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew, double epsilon);
+
+	//Compute the value function of a policy by momentum accelerated sweeps
+	vector<double> momentumPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew, double epsilon);
+
+	//Compute the value function of a policy by aggregation multigrid V-cycles
+	vector<double> multigridPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew, double epsilon);
+
+	//LU factorization of I - discount * P for the policy transition matrix factoredTransitions
+	matrix<double> factoredSystem;
+	permutation_matrix<std::size_t> factoredPivots;
+	matrix<double> factoredTransitions;
+
+	//columns of the inverse of the factorized system, cached per state for the low rank updates
+	std::map<int, vector<double> > inverseColumns;
+
+	//number of rows that may differ from the factorized policy before refactorizing
+	int maxUpdateRank;
+
+	//factorize I - discount * P for the given policy transition matrix
+	void factorizePolicy(const matrix<double> &policyTrans);
+
+	//Compute the value function of a policy from the cached factorization, Woodbury updating the rows
+	//that differ from the factorized policy and refactorizing when more than maxUpdateRank rows differ
+	vector<double> incrementalPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew);
+
+	//whether policyIteration and valueIteration solve a locality reordered copy of the model
+	bool reorderStates;
+
+	//copy of this MDP with its states renumbered so that new state k is old state order[k]
+	MDP renumbered(const std::vector<int> &order);
+
+	//renumbered copy solved when reorderStates is set and the reverseCuthillMcKee order it was built with. It is
+	//built on the first reordered solve and kept until the model changes
+	std::shared_ptr<MDP> reorderedModel;
+	std::vector<int> reorderedOrder;
+
+	//the cached renumbered copy, built if needed, with this model's current solver settings
+	MDP &reordered();
+
+	//take the backup count and the solved states of the last solve of the renumbered copy
+	void takeReorderedResults();
+
+	//policy of the renumbered copy in this model's numbering
+	matrix<double> fromReordered(const matrix<double> &localPolicy);
+
+	//optimal policy found by the last policy iteration, kept for reward-only re-solves (empty if none)
+	matrix<double> cachedOptimalPolicy;
+
+	//policy iteration from the given initial policy
+	matrix<double> policyIteration(matrix<double> initialPolicy);
+
+	//rows per tile of the BLOCKED scheme, 0 to size the diagonal block to the L2 cache
+	int tileSize;
+
+	//relaxation steps on each tile's diagonal block per sweep of the BLOCKED scheme
+	int tileSteps;
+
+	//Compute the value function of a policy by cache blocked sweeps
+	vector<double> blockedPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew, double epsilon);
+
+	//worker threads of the parallel solvers, 0 for one per usable CPU
+	int threadCount;
+
+	//whether the parallel solvers pin workers to NUMA nodes and place their data by first touch
+	bool numaPlacement;
+
+	//whether this model's backups and sums use the fixed order reductions
+	bool reproducible;
+
+	//number of worker threads the parallel solvers start
+	int workerCount();
+
+	//CPU each of the given number of workers is pinned to (-1 for none when NUMA placement is off)
+	std::vector<int> workerCpus(int threads);
+
+	//threads of the parallel solvers, kept across calls (shared by copies of this MDP)
+	std::shared_ptr<WorkerPool> workerPool;
+
+	//the worker pool, restarted only when the thread count or placement changed
+	WorkerPool &workers();
+
+	//target number of transition nonzeros per chunk of the parallel solvers, 0 for about eight chunks per worker
+	int chunkWork;
+
+	//split the given states (every state in index order if empty) into chunks of similar transition nonzero
+	//counts, chunk c being positions chunkStart[c] to chunkStart[c + 1] - 1 of the order, and give each worker a
+	//contiguous range of chunks, firstChunk[t] to firstChunk[t + 1] - 1, holding a similar share of the nonzeros
+	void partitionChunks(int threads, const std::vector<int> &order,
+			std::vector<int> &chunkStart, std::vector<int> &firstChunk);
+
+	//run in-place sweeps over the color classes on the parallel workers, with a barrier after each class, until
+	//the largest change of a sweep is at most epsilon. update(state) backs up a state in place and returns its
+	//change. Returns the number of sweeps
+	long coloredSweeps(const std::vector<int> &colors, double epsilon,
+			const std::function<double(int)> &update);
+
+	//Compute the value function of a policy by multi-color Gauss-Seidel sweeps on the parallel workers
+	vector<double> coloredPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew, double epsilon);
+
+	//colors above which the COLORED scheme runs Jacobi sweeps instead, since every color costs a barrier per sweep
+	static const int maxColors = 32;
+
+	//the model's compressed sparse rows, or scratch filled from the dense rows when the backups use those
+	const std::map<int, sparseRows> &compressedTransitions(
+			std::map<int, sparseRows> &scratch);
+
+	//greedy backup of the state reading only the nonzeros of the given rows, so never the value of a state it
+	//has no transition to (the maximizing action, or -1 if none is allowed, is returned through bestAction)
+	double compressedBackup(const std::map<int, sparseRows> &rows,
+			unsigned state, const vector<double> &valueFunc, int &bestAction);
+
+	//Compute the value function of a policy by synchronous sweeps over the solved states
+	vector<double> jacobiPolicyEvaluation(const matrix<double> &policyTrans,
+			const vector<double> &policyRew, double epsilon);
+
+	//private copy of the rewards and masks of a range of states, made by the worker that sweeps them so that it
+	//is placed on that worker's NUMA node (row k * numActions + a is action a of state begin + k). The transition
+	//rows are only copied too when copied is set, otherwise they are read from the model
+	struct stateRows {
+		int begin;
+		bool copied;
+		std::vector<double> rewards;
+		std::vector<char> allowed;
+		std::vector<char> solved;
+		std::vector<double> values;
+		std::vector<int> columns;
+		std::vector<int> rowStart;
+		std::vector<double, AlignedAllocator<double> > denseRows;
+	};
+
+	//whether the parallel solvers copy the transition rows to the node of the worker sweeping them, which only
+	//pays off with NUMA placement on a machine with more than one node
+	bool nodeLocalRows();
+
+	//copy the rewards and masks of states begin to end - 1, and their transition rows if copyRows is set
+	void copyStateRows(int begin, int end, bool copyRows, stateRows &rows);
+
+	//greedy backup of state rows.begin + k from its private rows (the maximizing action is returned through bestAction)
+	double rowsBackup(const stateRows &rows, int k, const double *valueFunc,
+			int &bestAction);
+
+	//greedy backup of state rows.begin + k reading a value function that other workers update concurrently
+	double rowsBackup(const stateRows &rows, int k,
+			const std::atomic<double> *valueFunc, int &bestAction);
+
+	//one synchronous sweep of greedy backups over the solved states
+	vector<double> greedySweep(const vector<double> &valueFunc);
+
+	//states the process may start from (empty means no reachability pruning)
+	std::vector<int> initialStates;
+
+	//whether reachability is computed under the current policy rather than under any action
+	bool reachUnderPolicy;
+
+	//states swept by the solve in progress, reachable from the initial states (empty means every state).
+	//Only set inside a solveScope, so public calls outside a solve see every state
+	std::vector<int> solveStates;
+
+	//membership mask for solveStates (empty means every state)
+	std::vector<bool> solvedMask;
+
+	//whether the solve in progress covers the state
+	bool inSolveSet(int state);
+
+	//states the last solve covered or RTDP labeled solved, reported by isSolved (empty means every state)
+	std::vector<bool> coveredMask;
+
+	//restrict solveStates to the states reachable under the given policy and, in stochastic shortest path mode,
+	//to the non-goal states with a proper policy. The covered states reported by isSolved are set to match
+	void restrictSolveStates(matrix<double> policy);
+
+	//restores the solveStates in effect when it was created, so a solver's restriction ends with the solver
+	struct solveScope {
+
+		solveScope(MDP &mdp);
+
+		~solveScope();
+
+		MDP &mdp;
+		std::vector<int> states;
+		std::vector<bool> mask;
+	};
+
+	//absorbing zero-reward goal states of the process
+	std::vector<bool> goalMask;
+
+	//whether the MDP is solved as a stochastic shortest path problem
+	bool shortestPath;
+
+	//states from which some policy reaches a goal with probability 1 (stochastic shortest path mode)
+	std::vector<bool> properMask;
+
+	//flattened state x action mask of the actions that keep a proper state within the proper states
+	//(empty means every action is allowed)
+	std::vector<bool> allowedActions;
+
+	//a proper policy over the proper states, used to start policy iteration in stochastic shortest path mode
+	matrix<double> properInitialPolicy;
+
+	//whether the action may be taken from the state
+	bool isAllowed(unsigned state, int action);
+
+	//compute properMask, allowedActions and properInitialPolicy from the goal states
+	void findProperStates();
+
+	//maximum undiscounted action value r(s,a) + P(s,.)h at the state, for the average reward criterion.
+	//Ties keep the given current action so that policy iteration terminates
+	double gainBackup(unsigned state, const vector<double> &bias,
+			int &bestAction, int currentAction = -1);
+
+	//random source for sampling successor states in the real-time dynamic programming solvers
+	std::mt19937 generator;
+
+	//sample a successor of the state from the given distribution over states (weights need not be normalized)
+	int sampleSuccessor(const vector<double> &weights);
+
+	//greedy backup of an RTDP trial: a state without an allowed action is a dead end worth 0, as in
+	//backwardInduction, and gets action -1
+	double trialBackup(int state, const vector<double> &valueFunc, int &action);
+
+	//mark the given states as the solved set reported by isSolved
+	void labelSolved(const std::vector<bool> &solved);
+
+	//LRTDP labeling procedure: label the greedy envelope of the state as solved if all its residuals are below epsilon,
+	//otherwise back up the states of the envelope
+	bool checkSolved(int state, double epsilon, vector<double> &valueFunc,
+			std::vector<bool> &solved);
+
+	//build the predecessor lists from the stored transitions
+	void buildPredecessors();
+
+	//value of taking the given action from the given state under the given value function
+	double stateActionValue(unsigned state, int action,
+			const vector<double> &valueFunc);
+
+	//action values of every action at the given state, indexed by action (actions are 0 to numActions - 1)
+	void stateActionValues(unsigned state, const vector<double> &valueFunc,
+			double *values);
+
+	//maximum action value at the given state (the maximizing action is returned through bestAction, the lowest on ties)
+	double greedyBackup(unsigned state, const vector<double> &valueFunc,
+			int &bestAction);
+
 public:
 
 	//Constructor initializing all member variables
@@ -51,12 +419,191 @@ public:
 	//Compute the value function associated with a given policy
 	vector<double> policyEvaluation(matrix<double> policyTrans, vector<double> policyRew, double epsilon);
 
+	//Compute the value function associated with a given policy, only recomputing states with a changed successor value
+	vector<double> activeSetPolicyEvaluation(matrix<double> policyTrans, vector<double> policyRew, double epsilon);
+
+	//Compute the value function associated with a given policy by solving (I - discount * P) v = r directly
+	vector<double> exactPolicyEvaluation(matrix<double> policyTrans, vector<double> policyRew);
+
+	//number of changed policy rows the INCREMENTAL scheme applies as low rank updates before refactorizing (default 16)
+	void setMaxUpdateRank(int rank);
+
+	//tile shape of the BLOCKED scheme: rows per tile (0 sizes the diagonal block to a 256KB L2 cache) and
+	//relaxation steps on the diagonal block per sweep (default 0 and 4). Throws std::invalid_argument for negative
+	//rows or fewer than one step
+	void setTiling(int rows, int steps);
+
+	//select the iteration scheme used by policyEvaluation (and therefore policyIteration)
+	void setEvaluationScheme(EvaluationScheme scheme);
+
+	//only solve for states reachable from the given start states. If underPolicy is set, reachability
+	//follows the current policy in each iteration instead of every action with a nonzero transition
+	void setInitialStates(std::vector<int> states, bool underPolicy = false);
+
+	//only solve for states reachable from the support of the given initial state distribution
+	void setInitialDistribution(vector<double> distribution, bool underPolicy = false);
+
+	//states reachable from the initial states, following only the actions the given policy takes
+	//(an empty policy matrix follows every action)
+	std::vector<int> reachableStates(matrix<double> policy);
+
+	//compute the optimal average reward (gain) and relative values (bias) by relative value iteration, normalizing
+	//the bias to zero at referenceState. Iterates until the span of the Bellman update is below epsilon.
+	//For periodic models pass aperiodicity < 1 to iterate on the aperiodic transform tau*P + (1 - tau)*I instead
+	vector<double> relativeValueIteration(double epsilon, double &gain,
+			int referenceState = 0, double aperiodicity = 1.0);
+
+	//gain and bias of a unichain policy: solves g + h = r + P h with h(referenceState) = 0, returns the bias
+	vector<double> averageRewardEvaluation(matrix<double> policyTrans,
+			vector<double> policyRew, double &gain, int referenceState = 0);
+
+	//compute the gain optimal policy of a unichain MDP by average reward policy iteration
+	matrix<double> averageRewardPolicyIteration(double &gain,
+			int referenceState = 0);
+
+	//solve a finite horizon problem of the given number of stages by backward induction from terminalValue.
+	//Returns the greedy action of every state at every stage (stage 0 first). stageValues receives the value
+	//functions of stages 0 to keepStages - 1, the last ones computed, or of every stage if keepStages is 0.
+	//stageModel may supply a different model for some stages; all models must share the state and action sets.
+	//States with no allowed action get noAction and value 0. Throws if numActions does not fit an ActionIndex
+	std::vector<std::vector<ActionIndex> > backwardInduction(int horizon,
+			vector<double> terminalValue,
+			std::vector<vector<double> > &stageValues, int keepStages = 0,
+			StageModel stageModel = StageModel());
+
+	//mark the given states as absorbing goals with zero value
+	void setGoalStates(std::vector<int> goals);
+
+	//whether the state is an absorbing goal
+	bool isGoal(int state);
+
+	//states that every action keeps in place with probability 1 and zero reward
+	std::vector<int> absorbingStates();
+
+	//solve the MDP as a stochastic shortest path problem (the discount may be 1). Absorbing states are detected
+	//as goals once and are not swept. States from which no policy reaches a goal with probability 1 are
+	//reported as unsolved, actions that could leave the remaining states are never taken, and policy iteration
+	//starts from a proper policy. Improper policies are assumed to have unbounded negative value.
+	void setStochasticShortestPath(bool enabled);
+
+	//compute the optimal value function on the greedy envelope of the start state by labeled RTDP.
+	//upperBound must never underestimate the optimal value of a state
+	vector<double> labeledRTDP(int start, double epsilon,
+			StateHeuristic upperBound);
+
+	//compute upper and lower bounds on the optimal value function around the start state by bounded RTDP.
+	//Trials follow the upper bound's greedy action and sample successors by their bound gap; a trial ends
+	//once the expected gap falls below the start state's gap divided by tau. Returns the upper bound
+	vector<double> boundedRTDP(int start, double epsilon,
+			StateHeuristic upperBound, StateHeuristic lowerBound,
+			vector<double> &lowerValue, double tau = 10.0);
+
+	//whether the last policyIteration or hybridIteration covered this state (unsolved states have an all-zero
+	//policy row). After labeledRTDP or boundedRTDP these are the states labeled solved
+	bool isSolved(int state);
+
+	//number of previous iterates mixed by Anderson acceleration (default 5)
+	void setAndersonDepth(int depth);
+
+	//SOR relaxation factor in (0,2); 0 (the default) estimates it from the convergence rate of the first sweeps
+	void setRelaxation(double omega);
+
+	//compute the optimal value function by synchronous value iteration until the largest change is below epsilon
+	vector<double> valueIteration(double epsilon);
+
 	//Greedy policy improvement given the current policy's value function
 	matrix<double> policyImprovement(vector<double> valueFunction);
 
+	//Greedy policy improvement that keeps the current action on ties and reports the states whose action changed
+	matrix<double> policyImprovement(vector<double> valueFunction,
+			matrix<double> currentPolicy, std::vector<int> &changedStates);
+
+	//recompute the given states' rows of the policy transition matrix and policy reward vector for a new policy
+	void updatePolicyRows(matrix<double> policy, std::vector<int> states,
+			matrix<double> &policyTrans, vector<double> &policyRew);
+
 	//compute the optimal policy for this MDP (corresponding value function can be found using policyEvalution method)
 	matrix<double> policyIteration();
 
+	//locality improving order of the states by reverse Cuthill-McKee on the symmetrized transition graph
+	//(entry k is the state placed at position k)
+	std::vector<int> reverseCuthillMcKee();
+
+	//solve a copy of the model renumbered by reverseCuthillMcKee inside policyIteration, valueIteration and
+	//resolvePolicy, so successor rows touch nearby value entries. Policies, values and isSolved are reported in
+	//the original numbering. The copy is built once and kept until the goals, initial states or shortest path
+	//mode change (reward changes are passed on to it)
+	void setStateReordering(bool enabled);
+
+	//replace the reward matrix, keeping the transitions (and anything cached from them)
+	void setActionReward(matrix<double> reward);
+
+	//recompute the optimal policy after a reward change. The last optimal policy is evaluated exactly with a cached
+	//factorization of its system and returned if it is still greedy; otherwise policy iteration continues from
+	//the improved policy
+	matrix<double> resolvePolicy();
+
+	//tolerance policyIteration evaluates each policy to (default 0.001)
+	void setEvaluationTolerance(double epsilon);
+
+	//inexact policy iteration: each policy is evaluated only to a tenth of the previous Bellman optimality residual,
+	//never looser than the previous tolerance. An unchanged policy is re-evaluated at the final tolerance before
+	//policyIteration stops, so it terminates under the same test as exact evaluation
+	void setInexactPolicyIteration(bool enabled);
+
+	//compute the optimal policy by value iteration sweeps until the greedy policy is stable and the observed residual
+	//decay predicts more remaining sweeps than an exact evaluation costs, then finish by policy iteration with
+	//exact evaluation. Value iteration alone is used if its residual falls below epsilon first
+	matrix<double> hybridIteration(double epsilon);
+
+	//compute the optimal value function by prioritized sweeping, backing up the state with the largest Bellman residual first.
+	//Stops once every residual is below epsilon or, if budget > 0, after budget backups
+	vector<double> prioritizedSweeping(double epsilon, long budget = 0);
+
+	//worker threads used by the parallel solvers, 0 (the default) for one per CPU this process may run on
+	void setThreadCount(int threads);
+
+	//pin the parallel solvers' workers to the NUMA nodes owning their states and let each worker allocate and
+	//first touch its own transition rows and value slices (default on). The rows are only copied per worker on
+	//machines with more than one NUMA node
+	void setNumaPlacement(bool enabled);
+
+	//advise the transition rows and the parallel solvers' arrays of at least 2MB to use transparent huge pages
+	//(default off)
+	void setHugePageBacking(bool enabled);
+
+	//use the fixed order reductions in this model's backups and sums, so its solves are bit-identical whatever the
+	//instruction set and number of workers (asynchronousValueIteration runs the synchronous sweeps instead). Only
+	//this model is affected; it starts in the process default mode of setReproducibleReductions in BellmanKernels
+	void setReproducibleReductions(bool enabled);
+
+	//target number of transition nonzeros per chunk of work handed to a parallel worker (0, the default, splits
+	//the states into about eight chunks per worker). Chunks are balanced by nonzeros rather than by states, and
+	//idle workers steal chunks from busy ones
+	void setChunkSize(int nonzeros);
+
+	//compute the optimal value function by synchronous value iteration, sweeping chunks of states on parallel
+	//worker threads until the largest change is below epsilon. Every backup of a sweep reads the same iterate and
+	//the workers' residuals are combined by a maximum, so the result does not depend on the number of workers
+	vector<double> parallelValueIteration(double epsilon);
+
+	//compute the optimal value function by asynchronous value iteration: each worker repeatedly backs up its own
+	//chunks in place with relaxed atomic loads and stores and no barrier between sweeps. It stops once every worker
+	//has completed a whole pass during a period in which no worker changed a value by more than epsilon. The order
+	//of updates, and so the result within the tolerance, differs from run to run, so with reproducible reductions
+	//(see setReproducibleReductions) this runs parallelValueIteration instead
+	vector<double> asynchronousValueIteration(double epsilon);
+
+	//color of each state of a greedy coloring of the transition graph: no action moves between two distinct
+	//states of the same color, so the states of a color can be backed up in place concurrently
+	std::vector<int> stateColoring();
+
+	//Greedy policy improvement given the current policy's value function, on the parallel worker threads
+	matrix<double> parallelPolicyImprovement(vector<double> valueFunction);
+
+	//number of single-state Bellman backups performed by the most recent solver call
+	long getBackupCount();
+
 };
 
 #endif /* MDP_HPP_ */
@@ -0,0 +1,303 @@
+//============================================================================
+// Name        : ParallelRuntime.cpp
+// Author      : Alex Minnaar
+// Description : NUMA topology detection, thread pinning, sweep barriers, worker pools and work stealing
+//============================================================================
+#include<fstream>
+#include<sstream>
+#include<string>
+#include<algorithm>
+#include <sched.h>
+#include <dirent.h>
+#include "ParallelRuntime.hpp"
+
+//CPUs listed in a sysfs cpulist such as "0-3,8-11"
+static std::vector<int> parseCpuList(const std::string &list) {
+
+	std::vector<int> cpus;
+	std::stringstream ranges(list);
+	std::string range;
+
+	while (std::getline(ranges, range, ',')) {
+
+		if (range.empty() || range[0] == '\n') {
+			continue;
+		}
+
+		int first = 0;
+		int last = 0;
+		char dash = 0;
+		std::stringstream bounds(range);
+
+		bounds >> first;
+		last = (bounds >> dash >> last) ? last : first;
+
+		for (int cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(cpu);
+		}
+	}
+
+	return cpus;
+}
+
+//NUMA nodes with at least one usable CPU
+std::vector<NumaNode> numaTopology() {
+
+	cpu_set_t usable;
+	CPU_ZERO(&usable);
+
+	bool haveMask = sched_getaffinity(0, sizeof(usable), &usable) == 0;
+
+	std::vector<NumaNode> nodes;
+
+	if (DIR *directory = opendir("/sys/devices/system/node")) {
+
+		while (dirent *entry = readdir(directory)) {
+
+			std::string name = entry->d_name;
+
+			if (name.compare(0, 4, "node") != 0 || name.size() == 4
+					|| name.find_first_not_of("0123456789", 4)
+							!= std::string::npos) {
+				continue;
+			}
+
+			std::ifstream file(
+					"/sys/devices/system/node/" + name + "/cpulist");
+			std::string list;
+			std::getline(file, list);
+
+			NumaNode node;
+			node.id = std::stoi(name.substr(4));
+
+			std::vector<int> cpus = parseCpuList(list);
+
+			for (unsigned k = 0; k < cpus.size(); ++k) {
+				if (!haveMask || CPU_ISSET(cpus[k], &usable)) {
+					node.cpus.push_back(cpus[k]);
+				}
+			}
+
+			if (!node.cpus.empty()) {
+				nodes.push_back(node);
+			}
+		}
+
+		closedir(directory);
+	}
+
+	if (!nodes.empty()) {
+
+		std::sort(nodes.begin(), nodes.end(),
+				[](const NumaNode &a, const NumaNode &b) {
+					return a.id < b.id;
+				});
+
+		return nodes;
+	}
+
+	//no NUMA information, one node holds every usable CPU
+	NumaNode node;
+	node.id = 0;
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (haveMask ? CPU_ISSET(cpu, &usable) : cpu == 0) {
+			node.cpus.push_back(cpu);
+		}
+	}
+
+	nodes.push_back(node);
+
+	return nodes;
+}
+
+//restrict the calling thread to the given CPU
+bool pinCurrentThread(int cpu) {
+
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+
+	return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+}
+
+//barrier for count threads
+SweepBarrier::SweepBarrier(int count) {
+	this->count = count;
+	this->waiting = 0;
+	this->generation = 0;
+}
+
+//block until every thread has arrived
+void SweepBarrier::wait() {
+
+	std::unique_lock<std::mutex> guard(this->lock);
+
+	long arrival = this->generation;
+
+	if (++this->waiting == this->count) {
+		this->waiting = 0;
+		++this->generation;
+		this->released.notify_all();
+		return;
+	}
+
+	this->released.wait(guard, [this, arrival] {
+		return this->generation != arrival;
+	});
+}
+
+//pool of pinned workers
+WorkerPool::WorkerPool(const std::vector<int> &cpus) {
+
+	this->cpus = cpus;
+	this->task = NULL;
+	this->generation = 0;
+	this->running = 0;
+	this->stopping = false;
+
+	for (unsigned t = 0; t < cpus.size(); ++t) {
+		this->threads.push_back(std::thread(&WorkerPool::serve, this, t));
+	}
+}
+
+//stop and join every worker
+WorkerPool::~WorkerPool() {
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->stopping = true;
+	}
+
+	this->started.notify_all();
+
+	for (unsigned t = 0; t < this->threads.size(); ++t) {
+		this->threads[t].join();
+	}
+}
+
+//number of workers
+int WorkerPool::size() {
+	return this->threads.size();
+}
+
+//CPU each worker was asked to run on
+const std::vector<int> &WorkerPool::workerCpus() {
+	return this->cpus;
+}
+
+//run the task on every worker and wait for all of them
+void WorkerPool::run(const std::function<void(int)> &task) {
+
+	std::lock_guard<std::mutex> serialized(this->runLock);
+	std::unique_lock<std::mutex> guard(this->lock);
+
+	this->task = &task;
+	this->running = this->threads.size();
+	++this->generation;
+
+	this->started.notify_all();
+
+	this->finished.wait(guard, [this] {
+		return this->running == 0;
+	});
+
+	this->task = NULL;
+}
+
+//body of each worker thread: wait for a task, run it, report back
+void WorkerPool::serve(int worker) {
+
+	if (this->cpus[worker] >= 0) {
+		pinCurrentThread(this->cpus[worker]);
+	}
+
+	long seen = 0;
+
+	while (true) {
+
+		const std::function<void(int)> *current;
+
+		{
+			std::unique_lock<std::mutex> guard(this->lock);
+
+			this->started.wait(guard, [this, seen] {
+				return this->stopping || this->generation != seen;
+			});
+
+			if (this->stopping) {
+				return;
+			}
+
+			seen = this->generation;
+			current = this->task;
+		}
+
+		(*current)(worker);
+
+		std::lock_guard<std::mutex> guard(this->lock);
+
+		if (--this->running == 0) {
+			this->finished.notify_one();
+		}
+	}
+}
+
+//scheduler for the given number of workers, with every range empty
+StealingScheduler::StealingScheduler(int workers) :
+		ranges(2 * workers) {
+
+	this->workers = workers;
+
+	for (unsigned k = 0; k < this->ranges.size(); ++k) {
+		this->ranges[k].bounds = 0;
+		this->ranges[k].stolen = 0;
+	}
+}
+
+//give the worker a range of chunks for the round
+void StealingScheduler::refill(int worker, long round, int first, int last) {
+
+	this->ranges[(round % 2) * this->workers + worker].bounds =
+			(unsigned long long) first << 32 | (unsigned) last;
+}
+
+//next chunk for the worker in the round
+bool StealingScheduler::next(int worker, long round, int &chunk) {
+
+	chunkRange *roundRanges = &this->ranges[(round % 2) * this->workers];
+
+	//own range, from the front
+	std::atomic<unsigned long long> &own = roundRanges[worker].bounds;
+	unsigned long long bounds = own.load();
+
+	while ((unsigned) (bounds >> 32) < (unsigned) bounds) {
+		if (own.compare_exchange_weak(bounds, bounds + (1ull << 32))) {
+			chunk = bounds >> 32;
+			return true;
+		}
+	}
+
+	//steal from the back of the other ranges, neighbours first since they share the NUMA node
+	for (int offset = 1; offset < this->workers; ++offset) {
+
+		std::atomic<unsigned long long> &victim = roundRanges[(worker + offset)
+				% this->workers].bounds;
+		bounds = victim.load();
+
+		while ((unsigned) (bounds >> 32) < (unsigned) bounds) {
+			if (victim.compare_exchange_weak(bounds, bounds - 1)) {
+				chunk = (unsigned) bounds - 1;
+				++this->ranges[worker].stolen;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+//number of chunks the worker stole
+long StealingScheduler::stolen(int worker) {
+	return this->ranges[worker].stolen;
+}
@@ -0,0 +1,125 @@
+/*
+ * ParallelRuntime.hpp
+ *
+ *	Threading support for the parallel solvers: NUMA topology detection, thread pinning, the barrier
+ *	separating synchronous sweeps, a persistent worker pool and a work-stealing chunk scheduler.
+ *
+ *      Author: alexminnaar
+ */
+
+#ifndef PARALLELRUNTIME_HPP_
+#define PARALLELRUNTIME_HPP_
+
+#include<vector>
+#include<mutex>
+#include<condition_variable>
+#include<thread>
+#include<atomic>
+#include<functional>
+
+//a NUMA node and the CPUs of it this process may run on
+struct NumaNode {
+	int id;
+	std::vector<int> cpus;
+};
+
+//NUMA nodes with at least one usable CPU, from /sys/devices/system/node. Machines without NUMA
+//information are reported as a single node holding every usable CPU
+std::vector<NumaNode> numaTopology();
+
+//restrict the calling thread to the given CPU, returns false if the CPU could not be set
+bool pinCurrentThread(int cpu);
+
+//reusable barrier for a fixed number of threads
+class SweepBarrier {
+
+public:
+
+	SweepBarrier(int count);
+
+	//block until every thread has arrived
+	void wait();
+
+private:
+
+	std::mutex lock;
+	std::condition_variable released;
+	int count;
+	int waiting;
+	long generation;
+};
+
+//threads started once and reused for every parallel task, so solvers do not pay a thread start per call
+class WorkerPool {
+
+public:
+
+	//one worker per entry, pinned to that CPU (a negative entry leaves the worker unpinned)
+	WorkerPool(const std::vector<int> &cpus);
+
+	~WorkerPool();
+
+	//number of workers
+	int size();
+
+	//CPU each worker was asked to run on
+	const std::vector<int> &workerCpus();
+
+	//run task(worker) on every worker and wait until all of them return. Calls are serialized
+	void run(const std::function<void(int)> &task);
+
+private:
+
+	WorkerPool(const WorkerPool &);
+	WorkerPool &operator=(const WorkerPool &);
+
+	//body of each worker thread
+	void serve(int worker);
+
+	std::vector<int> cpus;
+	std::vector<std::thread> threads;
+
+	//held for the whole of a run call
+	std::mutex runLock;
+
+	std::mutex lock;
+	std::condition_variable started;
+	std::condition_variable finished;
+	const std::function<void(int)> *task;
+	long generation;
+	int running;
+	bool stopping;
+};
+
+//chunks of work shared out between workers for a sequence of rounds. Each worker owns a contiguous
+//range of chunks and takes them from the front; a worker whose range is empty steals from the back of
+//the other workers' ranges, nearest worker first. Rounds alternate between two sets of ranges, so an
+//owner may refill its range for the next round while others are still stealing in the current one
+class StealingScheduler {
+
+public:
+
+	StealingScheduler(int workers);
+
+	//give the worker chunks first to last - 1 for the given round (call before the round starts)
+	void refill(int worker, long round, int first, int last);
+
+	//next chunk for the worker in the given round, false once every range of the round is empty
+	bool next(int worker, long round, int &chunk);
+
+	//number of chunks the worker took from other workers' ranges since construction
+	long stolen(int worker);
+
+private:
+
+	//range of chunks packed as front << 32 | back, on its own cache line
+	struct alignas(64) chunkRange {
+		std::atomic<unsigned long long> bounds;
+		long stolen;
+	};
+
+	int workers;
+	std::vector<chunkRange> ranges;
+};
+
+#endif /* PARALLELRUNTIME_HPP_ */
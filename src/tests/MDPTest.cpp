@@ -12,7 +12,12 @@
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 #include<map>
+#include<random>
+#include<chrono>
 #include "../storage_adaptors.hpp"
+#include "../BellmanKernels.hpp"
+#include "../AlignedAllocator.hpp"
+#include "../ParallelRuntime.hpp"
 #include <boost/numeric/ublas/io.hpp>
 
 using namespace boost::numeric::ublas;
@@ -50,6 +55,75 @@ MDP createTestMDP(void) {
 	return myMDP;
 }
 
+//function creating a chain MDP: action 0 moves left and action 1 moves right with probability 0.9,
+//otherwise the state is unchanged. Only the last state is rewarded.
+MDP createChainMDP(int n, double discount, double goalReward = 1.0) {
+
+	matrix<double> left = zero_matrix<double>(n, n);
+	matrix<double> right = zero_matrix<double>(n, n);
+
+	for (int i = 0; i < n; ++i) {
+		left(i, std::max(i - 1, 0)) += 0.9;
+		left(i, i) += 0.1;
+		right(i, std::min(i + 1, n - 1)) += 0.9;
+		right(i, i) += 0.1;
+	}
+
+	std::map<int, matrix<double> > ps;
+
+	ps[0] = left;
+	ps[1] = right;
+
+	matrix<double> reward = zero_matrix<double>(n, 2);
+	reward(n - 1, 0) = goalReward;
+	reward(n - 1, 1) = goalReward;
+
+	return MDP(ps, reward, discount);
+}
+
+//function creating a stochastic shortest path problem: states 0-4 form a chain with cost 1 per step,
+//state 5 is an absorbing goal and state 6 is a costly trap that moving left from state 0 falls into
+MDP createTrapMDP(void) {
+
+	const int n = 7;
+
+	matrix<double> left = zero_matrix<double>(n, n);
+	matrix<double> right = zero_matrix<double>(n, n);
+	matrix<double> reward = scalar_matrix<double>(n, 2, -1.0);
+
+	for (int i = 0; i < 5; ++i) {
+		left(i, i == 0 ? 6 : i - 1) += 0.9;
+		left(i, i) += 0.1;
+		right(i, i + 1) += 0.9;
+		right(i, i) += 0.1;
+	}
+
+	left(5, 5) = right(5, 5) = 1.0;
+	left(6, 6) = right(6, 6) = 1.0;
+	reward(5, 0) = reward(5, 1) = 0.0;
+
+	std::map<int, matrix<double> > ps;
+	ps[0] = left;
+	ps[1] = right;
+
+	MDP myMDP = MDP(ps, reward, 1.0);
+	myMDP.setStochasticShortestPath(true);
+
+	return myMDP;
+}
+
+//policy always taking the given action
+matrix<double> constantPolicy(int n, int action) {
+
+	matrix<double> policy = zero_matrix<double>(n, 2);
+
+	for (int i = 0; i < n; ++i) {
+		policy(i, action) = 1.0;
+	}
+
+	return policy;
+}
+
 TEST_CASE("action policy matrix is computed","[policyTransitions]") {
 
 	MDP myMDP = createTestMDP();
@@ -208,3 +282,1317 @@ TEST_CASE("full policy iteration algorithm","[policyIteration]"){
 	}
 
 }
+
+//value function of the optimal policy of the test MDP, evaluated to high precision
+vector<double> optimalTestValue(MDP &myMDP) {
+
+	double policy[3][2] = { 0.0, 1.0, 0.0, 1.0, 1.0, 0.0 };
+	matrix<double> A(3, 2);
+	A = make_matrix_from_pointer(policy);
+
+	return myMDP.policyEvaluation(myMDP.policyTransitions(A),
+			myMDP.policyReward(A), 1e-10);
+}
+
+TEST_CASE("prioritized sweeping finds the optimal value function","[prioritizedSweeping]"){
+
+	MDP myMDP = createTestMDP();
+
+	vector<double> correct = optimalTestValue(myMDP);
+
+	vector<double> vFunc = myMDP.prioritizedSweeping(1e-8);
+
+	for (int i = 0; i < 3; i++) {
+		REQUIRE(std::fabs(vFunc(i) - correct(i)) < 1e-6);
+	}
+
+	//a budgeted run stops after the given number of backups
+	myMDP.prioritizedSweeping(1e-8, 5);
+
+	REQUIRE(myMDP.getBackupCount() == 5);
+}
+
+TEST_CASE("active set evaluation skips converged states","[policyEvaluation]"){
+
+	MDP myMDP = createChainMDP(40, 0.9);
+
+	matrix<double> policy = constantPolicy(40, 1);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	vector<double> jacobi = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+	long jacobiBackups = myMDP.getBackupCount();
+
+	myMDP.setEvaluationScheme(MDP::ACTIVE_SET);
+
+	vector<double> active = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+
+	for (int i = 0; i < 40; i++) {
+		REQUIRE(std::fabs(active(i) - jacobi(i)) < 1e-6);
+	}
+
+	REQUIRE(myMDP.getBackupCount() < jacobiBackups);
+
+	//under a random walk every state keeps changing by small amounts, which must still reach its predecessors
+	matrix<double> walk = scalar_matrix<double>(40, 2, 0.5);
+	matrix<double> walkTrans = myMDP.policyTransitions(walk);
+	vector<double> walkRew = myMDP.policyReward(walk);
+
+	REQUIRE(norm_inf(myMDP.policyEvaluation(walkTrans, walkRew, 1e-8)
+			- myMDP.exactPolicyEvaluation(walkTrans, walkRew)) < 1e-6);
+}
+
+TEST_CASE("solving is restricted to states reachable from the initial states","[policyIteration]"){
+
+	MDP myMDP = createChainMDP(10, 0.9);
+
+	std::vector<int> start(1, 5);
+
+	myMDP.setInitialStates(start, true);
+
+	//moving right from state 5 never visits the states to its left
+	std::vector<int> reachable = myMDP.reachableStates(constantPolicy(10, 1));
+
+	REQUIRE(reachable.size() == 5);
+	REQUIRE(reachable[0] == 5);
+
+	//under every action the whole chain is reachable
+	REQUIRE(myMDP.reachableStates(matrix<double>()).size() == 10);
+
+	matrix<double> optimalPolicy = myMDP.policyIteration();
+
+	for (int i = 0; i < 10; i++) {
+
+		REQUIRE(myMDP.isSolved(i) == (i >= 5));
+
+		if (i >= 5) {
+			REQUIRE(optimalPolicy(i, 1) == 1.0);
+		} else {
+			REQUIRE(optimalPolicy(i, 0) + optimalPolicy(i, 1) == 0.0);
+		}
+	}
+
+	//the restriction ends with the solve, so later calls build every row
+	matrix<double> right = constantPolicy(10, 1);
+	matrix<double> rightTrans = myMDP.policyTransitions(right);
+
+	for (int i = 0; i < 10; i++) {
+		REQUIRE(sum(row(rightTrans, i)) == 1.0);
+	}
+
+	vector<double> rightValue = myMDP.policyEvaluation(rightTrans,
+			myMDP.policyReward(right), 1e-10);
+
+	REQUIRE(rightValue(0) > 0.0);
+}
+
+//upper and lower bounds on any value of the discount 0.9 chain, whose rewards lie in [0,1]
+double chainUpperBound(int) {
+	return 10.0;
+}
+
+double chainLowerBound(int) {
+	return 0.0;
+}
+
+TEST_CASE("labeled and bounded RTDP solve the start state","[RTDP]"){
+
+	MDP myMDP = createChainMDP(10, 0.9);
+
+	matrix<double> policy = constantPolicy(10, 1);
+	vector<double> correct = myMDP.policyEvaluation(
+			myMDP.policyTransitions(policy), myMDP.policyReward(policy), 1e-10);
+
+	vector<double> lrtdp = myMDP.labeledRTDP(0, 1e-6, chainUpperBound);
+
+	REQUIRE(std::fabs(lrtdp(0) - correct(0)) < 1e-4);
+	REQUIRE(myMDP.isSolved(0));
+
+	vector<double> lower;
+	vector<double> upper = myMDP.boundedRTDP(0, 1e-4, chainUpperBound,
+			chainLowerBound, lower);
+
+	REQUIRE(upper(0) - lower(0) <= 1e-4);
+	REQUIRE(upper(0) >= correct(0) - 1e-6);
+	REQUIRE(lower(0) <= correct(0) + 1e-6);
+	REQUIRE(myMDP.isSolved(0));
+
+	//trials from state 5 never reach state 0, which stays unlabeled but is still covered by later evaluations
+	myMDP.labeledRTDP(5, 1e-6, chainUpperBound);
+
+	REQUIRE(!myMDP.isSolved(0));
+	REQUIRE(norm_inf(myMDP.policyEvaluation(myMDP.policyTransitions(policy),
+			myMDP.policyReward(policy), 1e-10) - correct) < 1e-12);
+
+	//the shortest path trap has no allowed action, so trials stop there and it is solved with value 0
+	MDP trapMDP = createTrapMDP();
+
+	MDP::StateHeuristic zeroBound = [](int) {return 0.0;};
+	MDP::StateHeuristic costBound = [](int) {return -10.0;};
+
+	vector<double> trapValues = trapMDP.labeledRTDP(6, 1e-6, zeroBound);
+
+	REQUIRE(trapValues(6) == 0.0);
+	REQUIRE(trapMDP.isSolved(6));
+
+	trapValues = trapMDP.labeledRTDP(0, 1e-6, zeroBound);
+
+	REQUIRE(std::fabs(trapValues(0) + 5 / 0.9) < 1e-4);
+
+	vector<double> trapLower;
+	vector<double> trapUpper = trapMDP.boundedRTDP(6, 1e-4, zeroBound,
+			costBound, trapLower);
+
+	REQUIRE(trapUpper(6) == 0.0);
+	REQUIRE(trapLower(6) == 0.0);
+	REQUIRE(trapMDP.isSolved(6));
+}
+
+TEST_CASE("stochastic shortest path mode with absorbing goals","[stochasticShortestPath]"){
+
+	MDP myMDP = createTrapMDP();
+
+	REQUIRE(myMDP.absorbingStates().size() == 1);
+	REQUIRE(myMDP.isGoal(5));
+
+	matrix<double> optimalPolicy = myMDP.policyIteration();
+	vector<double> vFunc = myMDP.policyEvaluation(
+			myMDP.policyTransitions(optimalPolicy),
+			myMDP.policyReward(optimalPolicy), 1e-10);
+
+	for (int i = 0; i < 5; i++) {
+		REQUIRE(optimalPolicy(i, 1) == 1.0);
+		REQUIRE(std::fabs(vFunc(i) + (5 - i) / 0.9) < 1e-6);
+		REQUIRE(myMDP.isSolved(i));
+	}
+
+	//the trap never reaches the goal
+	REQUIRE(!myMDP.isSolved(6));
+	REQUIRE(vFunc(5) == 0.0);
+}
+
+TEST_CASE("average reward by relative value iteration and policy iteration","[averageReward]"){
+
+	MDP myMDP = createTestMDP();
+
+	double piGain;
+	matrix<double> policy = myMDP.averageRewardPolicyIteration(piGain);
+
+	double rviGain;
+	vector<double> rviBias = myMDP.relativeValueIteration(1e-10, rviGain);
+
+	REQUIRE(std::fabs(piGain - rviGain) < 1e-8);
+
+	double evaluatedGain;
+	vector<double> piBias = myMDP.averageRewardEvaluation(
+			myMDP.policyTransitions(policy), myMDP.policyReward(policy),
+			evaluatedGain);
+
+	REQUIRE(evaluatedGain == piGain);
+
+	for (int i = 0; i < 3; i++) {
+		REQUIRE(std::fabs(piBias(i) - rviBias(i)) < 1e-6);
+	}
+
+	//the aperiodic transform has the same gain
+	myMDP.relativeValueIteration(1e-10, rviGain, 0, 0.5);
+
+	REQUIRE(std::fabs(piGain - rviGain) < 1e-8);
+}
+
+TEST_CASE("finite horizon backward induction","[backwardInduction]"){
+
+	MDP myMDP = createChainMDP(10, 0.9);
+
+	std::vector<vector<double> > stageValues;
+
+	std::vector<std::vector<MDP::ActionIndex> > policy =
+			myMDP.backwardInduction(3, zero_vector<double>(10), stageValues,
+					1);
+
+	REQUIRE(policy.size() == 3);
+	REQUIRE(stageValues.size() == 1);
+
+	//three rewarded steps at the end of the chain
+	REQUIRE(std::fabs(stageValues[0](9) - 2.71) < 1e-12);
+
+	//two steps from the end, moving right is the only way to collect a reward in three stages
+	REQUIRE(policy[0][7] == 1);
+	REQUIRE(stageValues[0](6) == 0.0);
+
+	//a different model in the final stage doubles the terminal step's reward
+	MDP doubled = createChainMDP(10, 0.9, 2.0);
+
+	std::vector<vector<double> > allValues;
+
+	myMDP.backwardInduction(3, zero_vector<double>(10), allValues, 0,
+			[&](int stage) {
+				return stage == 2 ? &doubled : (MDP *) NULL;
+			});
+
+	REQUIRE(allValues.size() == 3);
+	REQUIRE(std::fabs(allValues[2](9) - 2.0) < 1e-12);
+	REQUIRE(std::fabs(allValues[0](9) - 3.52) < 1e-12);
+
+	//the trap state has no proper action, so it gets none and keeps value 0
+	MDP trapMDP = createTrapMDP();
+
+	std::vector<std::vector<MDP::ActionIndex> > trapPolicy =
+			trapMDP.backwardInduction(4, zero_vector<double>(7), allValues);
+
+	for (int stage = 0; stage < 4; ++stage) {
+		REQUIRE(trapPolicy[stage][6] == MDP::noAction);
+		REQUIRE(trapPolicy[stage][0] == 1);
+		REQUIRE(allValues[stage](6) == 0.0);
+	}
+}
+
+TEST_CASE("Anderson acceleration reduces the number of sweeps","[anderson]"){
+
+	MDP myMDP = createChainMDP(40, 0.99);
+
+	matrix<double> policy = constantPolicy(40, 1);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	vector<double> plain = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+	long plainBackups = myMDP.getBackupCount();
+
+	vector<double> plainOptimal = myMDP.valueIteration(1e-8);
+	long plainIterationBackups = myMDP.getBackupCount();
+
+	myMDP.setEvaluationScheme(MDP::ANDERSON);
+
+	vector<double> accelerated = myMDP.policyEvaluation(policyTrans,
+			policyRew, 1e-8);
+
+	REQUIRE(myMDP.getBackupCount() < plainBackups);
+
+	vector<double> acceleratedOptimal = myMDP.valueIteration(1e-8);
+
+	REQUIRE(myMDP.getBackupCount() < plainIterationBackups);
+
+	for (int i = 0; i < 40; i++) {
+		REQUIRE(std::fabs(accelerated(i) - plain(i)) < 1e-4);
+		REQUIRE(std::fabs(acceleratedOptimal(i) - plainOptimal(i)) < 1e-4);
+	}
+}
+
+TEST_CASE("relaxed and momentum evaluation reduce the number of sweeps","[policyEvaluation]"){
+
+	MDP myMDP = createChainMDP(40, 0.99);
+
+	matrix<double> policy = constantPolicy(40, 1);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	vector<double> plain = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+	long plainBackups = myMDP.getBackupCount();
+
+	//estimated relaxation factor
+	myMDP.setEvaluationScheme(MDP::SOR);
+
+	vector<double> relaxed = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+
+	REQUIRE(myMDP.getBackupCount() < plainBackups);
+
+	//fixed relaxation factor
+	myMDP.setRelaxation(1.2);
+
+	vector<double> fixedRelaxed = myMDP.policyEvaluation(policyTrans,
+			policyRew, 1e-8);
+
+	REQUIRE(myMDP.getBackupCount() < plainBackups);
+
+	myMDP.setEvaluationScheme(MDP::MOMENTUM);
+
+	vector<double> momentum = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+
+	REQUIRE(myMDP.getBackupCount() < plainBackups);
+
+	for (int i = 0; i < 40; i++) {
+		REQUIRE(std::fabs(relaxed(i) - plain(i)) < 1e-4);
+		REQUIRE(std::fabs(fixedRelaxed(i) - plain(i)) < 1e-4);
+		REQUIRE(std::fabs(momentum(i) - plain(i)) < 1e-4);
+	}
+
+	//without discounting the value is the reward itself
+	MDP myopic = createChainMDP(40, 0.0);
+	myopic.setEvaluationScheme(MDP::MOMENTUM);
+
+	vector<double> immediate = myopic.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+
+	REQUIRE(norm_inf(immediate - policyRew) == 0.0);
+}
+
+TEST_CASE("multigrid evaluation matches plain evaluation","[policyEvaluation]"){
+
+	MDP myMDP = createChainMDP(100, 0.99);
+
+	matrix<double> policy = constantPolicy(100, 1);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	vector<double> plain = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+	long plainBackups = myMDP.getBackupCount();
+
+	myMDP.setEvaluationScheme(MDP::MULTIGRID);
+
+	vector<double> multigrid = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-8);
+
+	REQUIRE(myMDP.getBackupCount() < plainBackups);
+
+	for (int i = 0; i < 100; i++) {
+		REQUIRE(std::fabs(multigrid(i) - plain(i)) < 1e-4);
+	}
+
+	//small models are solved directly on the finest level
+	MDP testMDP = createTestMDP();
+	vector<double> correct = optimalTestValue(testMDP);
+
+	testMDP.setEvaluationScheme(MDP::MULTIGRID);
+
+	vector<double> direct = optimalTestValue(testMDP);
+
+	for (int i = 0; i < 3; i++) {
+		REQUIRE(std::fabs(direct(i) - correct(i)) < 1e-8);
+	}
+}
+
+TEST_CASE("multigrid evaluation survives singular and oversized coarse levels","[policyEvaluation]"){
+
+	//undiscounted path to a goal: the only leak is the goal's zeroed row, so the coarse systems are close to
+	//singular and aggregates away from the goal have no leak at all
+	const int n = 200;
+
+	matrix<double> right = zero_matrix<double>(n, n);
+	matrix<double> reward = scalar_matrix<double>(n, 1, -1.0);
+
+	for (int i = 0; i < n - 1; ++i) {
+		right(i, i + 1) = 0.9;
+		right(i, i) = 0.1;
+	}
+
+	right(n - 1, n - 1) = 1.0;
+	reward(n - 1, 0) = 0.0;
+
+	std::map<int, matrix<double> > ps;
+	ps[0] = right;
+
+	MDP pathMDP = MDP(ps, reward, 1.0);
+	pathMDP.setEvaluationScheme(MDP::MULTIGRID);
+
+	matrix<double> policy = scalar_matrix<double>(n, 1, 1.0);
+	matrix<double> policyTrans = pathMDP.policyTransitions(policy);
+	vector<double> policyRew = pathMDP.policyReward(policy);
+
+	policyTrans(n - 1, n - 1) = 0.0;
+
+	vector<double> multigrid = pathMDP.policyEvaluation(policyTrans,
+			policyRew, 1e-8);
+
+	for (int i = 0; i < n - 1; i++) {
+		REQUIRE(std::fabs(multigrid(i) + (n - 1 - i) / 0.9) < 1e-5);
+	}
+
+	//self loops have no neighbours to aggregate with, so coarsening stalls above the direct solve limit
+	const int m = 600;
+
+	std::map<int, matrix<double> > loops;
+	loops[0] = identity_matrix<double>(m);
+
+	MDP loopMDP = MDP(loops, scalar_matrix<double>(m, 1, 1.0), 0.9);
+	loopMDP.setEvaluationScheme(MDP::MULTIGRID);
+
+	matrix<double> stay = scalar_matrix<double>(m, 1, 1.0);
+
+	vector<double> relaxed = loopMDP.policyEvaluation(
+			loopMDP.policyTransitions(stay), loopMDP.policyReward(stay), 1e-8);
+
+	REQUIRE(std::fabs(norm_inf(relaxed) - 10.0) < 1e-6);
+}
+
+TEST_CASE("hybrid value and policy iteration","[hybridIteration]"){
+
+	MDP myMDP = createTestMDP();
+
+	matrix<double> optimalPolicy = myMDP.hybridIteration(1e-8);
+
+	double correct[3][2] = { 0.0, 1.0, 0.0, 1.0, 1.0, 0.0 };
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 2; j++) {
+			REQUIRE(optimalPolicy(i, j) == correct[i][j]);
+		}
+	}
+
+	//at a high discount value iteration stalls and the solver switches to policy iteration
+	MDP chainMDP = createChainMDP(30, 0.999);
+
+	vector<double> plain = chainMDP.valueIteration(1e-8);
+	long plainBackups = chainMDP.getBackupCount();
+
+	matrix<double> chainPolicy = chainMDP.hybridIteration(1e-8);
+
+	REQUIRE(chainMDP.getBackupCount() < plainBackups);
+
+	for (int i = 0; i < 30; i++) {
+		REQUIRE(chainPolicy(i, 1) == 1.0);
+	}
+
+	REQUIRE(norm_inf(chainMDP.exactPolicyEvaluation(
+			chainMDP.policyTransitions(chainPolicy),
+			chainMDP.policyReward(chainPolicy)) - plain) < 1e-3);
+}
+
+TEST_CASE("hybrid iteration skips states without an allowed action","[hybridIteration]"){
+
+	//the trap state has no proper action
+	MDP myMDP = createTrapMDP();
+
+	matrix<double> optimalPolicy = myMDP.hybridIteration(1e-10);
+
+	for (int i = 0; i < 5; i++) {
+		REQUIRE(optimalPolicy(i, 1) == 1.0);
+	}
+
+	REQUIRE(optimalPolicy(6, 0) == 0.0);
+	REQUIRE(optimalPolicy(6, 1) == 0.0);
+}
+
+TEST_CASE("inexact policy iteration finds the same policy with fewer sweeps","[policyIteration]"){
+
+	MDP myMDP = createChainMDP(40, 0.99);
+
+	myMDP.setEvaluationTolerance(1e-6);
+
+	matrix<double> exactPolicy = myMDP.policyIteration();
+	long exactBackups = myMDP.getBackupCount();
+
+	myMDP.setInexactPolicyIteration(true);
+
+	matrix<double> inexactPolicy = myMDP.policyIteration();
+
+	REQUIRE(myMDP.getBackupCount() < exactBackups);
+
+	for (int i = 0; i < 40; i++) {
+		REQUIRE(inexactPolicy(i, 0) == exactPolicy(i, 0));
+		REQUIRE(inexactPolicy(i, 1) == exactPolicy(i, 1));
+	}
+
+	//the inexact evaluations do not change the test MDP's optimal policy
+	MDP testMDP = createTestMDP();
+	testMDP.setInexactPolicyIteration(true);
+
+	matrix<double> optimalPolicy = testMDP.policyIteration();
+	double correct[3][2] = { 0.0, 1.0, 0.0, 1.0, 1.0, 0.0 };
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 2; j++) {
+			REQUIRE(optimalPolicy(i, j) == correct[i][j]);
+		}
+	}
+}
+
+TEST_CASE("policy improvement reports the states whose action changed","[policyImprovement]"){
+
+	MDP myMDP = createTestMDP();
+
+	//greedy for the values below is (1, 1, 0), so only state 1 changes
+	double policy[3][2] = { 0.0, 1.0, 1.0, 0.0, 1.0, 0.0 };
+	matrix<double> A(3, 2);
+	A = make_matrix_from_pointer(policy);
+
+	double vf[] = { 1.5, 0.9, 0.6 };
+	vector<double> valueFunction(3);
+	valueFunction = make_vector_from_pointer(3, vf);
+
+	std::vector<int> changedStates;
+	matrix<double> improvedPolicy = myMDP.policyImprovement(valueFunction, A,
+			changedStates);
+
+	REQUIRE(changedStates.size() == 1);
+	REQUIRE(changedStates[0] == 1);
+
+	//updating only the changed rows gives the full recomputation
+	matrix<double> policyTrans = myMDP.policyTransitions(A);
+	vector<double> policyRew = myMDP.policyReward(A);
+
+	myMDP.updatePolicyRows(improvedPolicy, changedStates, policyTrans,
+			policyRew);
+
+	REQUIRE(
+			norm_inf(policyTrans - myMDP.policyTransitions(improvedPolicy))
+					< 1e-15);
+	REQUIRE(
+			norm_inf(policyRew - myMDP.policyReward(improvedPolicy)) < 1e-15);
+
+	//improving the greedy policy changes nothing
+	myMDP.policyImprovement(valueFunction, improvedPolicy, changedStates);
+
+	REQUIRE(changedStates.empty());
+}
+
+TEST_CASE("incremental evaluation updates a cached factorization","[policyEvaluation]"){
+
+	MDP myMDP = createChainMDP(20, 0.95);
+
+	myMDP.setEvaluationScheme(MDP::INCREMENTAL);
+	myMDP.setMaxUpdateRank(3);
+
+	matrix<double> policy = constantPolicy(20, 1);
+
+	for (int changes = 0; changes <= 5; ++changes) {
+
+		//switch a growing number of states to moving left, past the update rank in the end
+		if (changes > 0) {
+			policy(2 * changes, 0) = 1.0;
+			policy(2 * changes, 1) = 0.0;
+		}
+
+		matrix<double> policyTrans = myMDP.policyTransitions(policy);
+		vector<double> policyRew = myMDP.policyReward(policy);
+
+		vector<double> incremental = myMDP.policyEvaluation(policyTrans,
+				policyRew, 0.0);
+		vector<double> exact = myMDP.exactPolicyEvaluation(policyTrans,
+				policyRew);
+
+		REQUIRE(norm_inf(incremental - exact) < 1e-10);
+	}
+
+	//policy iteration with incremental evaluation
+	MDP testMDP = createTestMDP();
+	testMDP.setEvaluationScheme(MDP::INCREMENTAL);
+
+	matrix<double> optimalPolicy = testMDP.policyIteration();
+	double correct[3][2] = { 0.0, 1.0, 0.0, 1.0, 1.0, 0.0 };
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 2; j++) {
+			REQUIRE(optimalPolicy(i, j) == correct[i][j]);
+		}
+	}
+}
+
+TEST_CASE("reward-only re-solves reuse the last optimal policy","[resolvePolicy]"){
+
+	MDP myMDP = createTestMDP();
+
+	matrix<double> optimalPolicy = myMDP.policyIteration();
+
+	//scaling the rewards keeps the optimal policy, which is verified with one solve
+	double scaled[3][2] = { 2, 4, 0, 2, 2, 0 };
+	matrix<double> reward(3, 2);
+	reward = make_matrix_from_pointer(scaled);
+
+	myMDP.setActionReward(reward);
+
+	matrix<double> resolved = myMDP.resolvePolicy();
+
+	REQUIRE(myMDP.getBackupCount() == 3);
+	REQUIRE(norm_inf(resolved - optimalPolicy) == 0.0);
+
+	//a reward change that flips state 2 to action 1 falls back to policy iteration
+	double flipped[3][2] = { 1, 2, 0, 1, 0, 5 };
+	reward = make_matrix_from_pointer(flipped);
+
+	myMDP.setActionReward(reward);
+
+	resolved = myMDP.resolvePolicy();
+
+	REQUIRE(resolved(2, 1) == 1.0);
+
+	MDP freshMDP = createTestMDP();
+	freshMDP.setActionReward(reward);
+
+	REQUIRE(norm_inf(resolved - freshMDP.policyIteration()) == 0.0);
+
+	//goals and the trap have no action to re-check, so an unchanged shortest path problem is verified with one solve
+	MDP trapMDP = createTrapMDP();
+
+	matrix<double> trapPolicy = trapMDP.policyIteration();
+
+	REQUIRE(norm_inf(trapMDP.resolvePolicy() - trapPolicy) == 0.0);
+	REQUIRE(trapMDP.getBackupCount() == 7);
+
+	for (int a = 0; a < 2; ++a) {
+		REQUIRE(trapPolicy(5, a) == 0.0);
+	}
+
+	//states pruned from the solve keep their empty rows instead of counting as changed
+	MDP chainMDP = createChainMDP(10, 0.9);
+
+	std::vector<int> start(1, 5);
+	chainMDP.setInitialStates(start, true);
+
+	matrix<double> chainPolicy = chainMDP.policyIteration();
+
+	REQUIRE(norm_inf(chainMDP.resolvePolicy() - chainPolicy) == 0.0);
+	REQUIRE(chainMDP.getBackupCount() == 10);
+
+	for (int i = 0; i < 10; ++i) {
+		REQUIRE(chainMDP.isSolved(i) == (i >= 5));
+	}
+}
+
+TEST_CASE("vectorized Bellman kernels agree with the scalar fallback","[kernels]"){
+
+	KernelInstructionSet widest = detectKernelInstructionSet();
+
+	//lengths around every vector width and unroll factor
+	for (int n = 0; n < 40; ++n) {
+
+		std::vector<double> x(n + 1), rows(6 * (n + 1)), values(n + 1);
+		std::vector<int> columns(n + 1);
+		double rewards[6] = { 0.5, 0.1, 0.3, 0.5, 0.2, 0.4 };
+
+		for (int j = 0; j <= n; ++j) {
+			x[j] = std::sin(j + 1.0);
+			values[j] = std::cos(3.0 * j);
+			columns[j] = (7 * j) % (n + 1);
+		}
+
+		for (unsigned k = 0; k < rows.size(); ++k) {
+			rows[k] = std::sin(0.7 * k);
+		}
+
+		const double *rowPointers[6];
+
+		for (int a = 0; a < 6; ++a) {
+			rowPointers[a] = &rows[a * (n + 1)];
+		}
+
+		double dense[3], sparse[3], best[3], q[6];
+		int action[3];
+
+		for (int isa = SCALAR_KERNELS; isa <= widest; ++isa) {
+
+			setKernelInstructionSet((KernelInstructionSet) isa);
+
+			dense[isa] = denseDot(&rows[0], &x[0], n);
+			sparse[isa] = sparseDot(&values[0], &columns[0], n, &x[0]);
+			actionValues(rowPointers, rewards, 6, &x[0], n, 0.9, q);
+			action[isa] = argmaxValue(q, 6, best[isa]);
+		}
+
+		for (int isa = SCALAR_KERNELS + 1; isa <= widest; ++isa) {
+			REQUIRE(std::fabs(dense[isa] - dense[SCALAR_KERNELS]) < 1e-12);
+			REQUIRE(std::fabs(sparse[isa] - sparse[SCALAR_KERNELS]) < 1e-12);
+			REQUIRE(std::fabs(best[isa] - best[SCALAR_KERNELS]) < 1e-12);
+			REQUIRE(action[isa] == action[SCALAR_KERNELS]);
+		}
+	}
+
+	setKernelInstructionSet(widest);
+
+	REQUIRE(kernelInstructionSet() == widest);
+}
+
+TEST_CASE("vectorized argmax breaks ties towards the lowest index","[kernels]"){
+
+	KernelInstructionSet widest = detectKernelInstructionSet();
+
+	for (int isa = SCALAR_KERNELS; isa <= widest; ++isa) {
+
+		setKernelInstructionSet((KernelInstructionSet) isa);
+
+		for (int count = 1; count <= 19; ++count) {
+
+			//two tied maxima in every position pair, the first must win
+			for (int first = 0; first < count; ++first) {
+				for (int second = first; second < count; ++second) {
+
+					std::vector<double> values(count, -1.0);
+					values[first] = values[second] = 2.5;
+
+					double best;
+
+					REQUIRE(argmaxValue(&values[0], count, best) == first);
+					REQUIRE(best == 2.5);
+				}
+			}
+		}
+	}
+
+	setKernelInstructionSet(widest);
+}
+
+TEST_CASE("aligned allocations start on cache lines or huge pages","[AlignedAllocator]"){
+
+	for (std::size_t n = 1; n < 100; n += 7) {
+
+		std::vector<double, AlignedAllocator<double> > values(n, 1.0);
+
+		REQUIRE((std::size_t) &values[0] % 64 == 0);
+	}
+
+	//huge page backing is a property of the allocator, other containers keep cache line alignment
+	AlignedAllocator<double> huge(true);
+
+	std::vector<double, AlignedAllocator<double> > large(
+			hugePageSize / sizeof(double), 1.0, huge);
+
+	REQUIRE((std::size_t) &large[0] % hugePageSize == 0);
+	REQUIRE(large.get_allocator().hugePageBacking());
+
+	std::vector<double, AlignedAllocator<double> > plain(
+			hugePageSize / sizeof(double), 1.0);
+
+	REQUIRE(!plain.get_allocator().hugePageBacking());
+
+	//dense models are backed up from the padded layout
+	MDP myMDP = createTestMDP();
+
+	myMDP.setHugePageBacking(true);
+
+	REQUIRE(norm_inf(myMDP.valueIteration(1e-12) - optimalTestValue(myMDP))
+			< 1e-8);
+}
+
+TEST_CASE("reverse Cuthill-McKee reordering recovers a scrambled chain","[reverseCuthillMcKee]"){
+
+	const int n = 30;
+
+	//scramble the chain, state i becomes state 7i mod n
+	matrix<double> left = zero_matrix<double>(n, n);
+	matrix<double> right = zero_matrix<double>(n, n);
+	matrix<double> reward = zero_matrix<double>(n, 2);
+
+	for (int i = 0; i < n; ++i) {
+		left((7 * i) % n, (7 * std::max(i - 1, 0)) % n) += 0.9;
+		left((7 * i) % n, (7 * i) % n) += 0.1;
+		right((7 * i) % n, (7 * std::min(i + 1, n - 1)) % n) += 0.9;
+		right((7 * i) % n, (7 * i) % n) += 0.1;
+	}
+
+	reward((7 * (n - 1)) % n, 0) = reward((7 * (n - 1)) % n, 1) = 1.0;
+
+	std::map<int, matrix<double> > ps;
+	ps[0] = left;
+	ps[1] = right;
+
+	MDP scrambled = MDP(ps, reward, 0.9);
+
+	std::vector<int> order = scrambled.reverseCuthillMcKee();
+	std::vector<int> position(n);
+
+	for (int k = 0; k < n; ++k) {
+		position[order[k]] = k;
+	}
+
+	//after renumbering every transition stays within one position
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < n; ++j) {
+			if (left(i, j) + right(i, j) != 0.0) {
+				REQUIRE(std::abs(position[i] - position[j]) <= 1);
+			}
+		}
+	}
+
+	//solving the reordered copy is transparent
+	vector<double> plain = scrambled.valueIteration(1e-10);
+	matrix<double> plainPolicy = scrambled.policyIteration();
+
+	scrambled.setStateReordering(true);
+
+	REQUIRE(norm_inf(scrambled.valueIteration(1e-10) - plain) < 1e-12);
+	REQUIRE(norm_inf(scrambled.policyIteration() - plainPolicy) == 0.0);
+
+	for (int i = 0; i < n; ++i) {
+		REQUIRE(plainPolicy((7 * i) % n, 1) == 1.0);
+	}
+
+	//the renumbered copy is kept, so a reward change re-solves from the copy's cached factorization
+	scrambled.setActionReward(2.0 * reward);
+
+	REQUIRE(norm_inf(scrambled.resolvePolicy() - plainPolicy) == 0.0);
+	REQUIRE(scrambled.getBackupCount() == n);
+
+	//the solved states come back in the original numbering
+	std::vector<int> start(1, (7 * 25) % n);
+
+	scrambled.setInitialStates(start, true);
+	scrambled.policyIteration();
+
+	for (int i = 0; i < n; ++i) {
+		REQUIRE(scrambled.isSolved((7 * i) % n) == (i >= 25));
+	}
+}
+
+TEST_CASE("cache blocked evaluation converges to the policy value","[policyEvaluation]"){
+
+	MDP myMDP = createChainMDP(100, 0.95);
+
+	matrix<double> policy = constantPolicy(100, 1);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	vector<double> exact = myMDP.exactPolicyEvaluation(policyTrans, policyRew);
+
+	myMDP.setEvaluationScheme(MDP::BLOCKED);
+
+	//tiles that do not divide the state count
+	myMDP.setTiling(16, 4);
+
+	vector<double> blocked = myMDP.policyEvaluation(policyTrans, policyRew,
+			1e-9);
+
+	//every relaxation step of every tile is a backup
+	REQUIRE(myMDP.getBackupCount() % (4 * 100) == 0);
+	REQUIRE(norm_inf(blocked - exact) < 1e-6);
+
+	//the result is a fixed point of the policy's Bellman operator
+	vector<double> residual = policyRew + 0.95 * prod(policyTrans, blocked)
+			- blocked;
+
+	REQUIRE(norm_inf(residual) < 1e-8);
+
+	//a single tile holding every state
+	myMDP.setTiling(0, 2);
+
+	REQUIRE(norm_inf(myMDP.policyEvaluation(policyTrans, policyRew, 1e-9)
+			- exact) < 1e-6);
+
+	//a tile shape that would never back up a state is refused
+	REQUIRE_THROWS_AS(myMDP.setTiling(8, 0), std::invalid_argument);
+	REQUIRE_THROWS_AS(myMDP.setTiling(-1, 4), std::invalid_argument);
+}
+
+TEST_CASE("NUMA topology lists every usable CPU once","[parallel]"){
+
+	std::vector<NumaNode> nodes = numaTopology();
+
+	REQUIRE(!nodes.empty());
+
+	std::vector<int> cpus;
+
+	for (unsigned k = 0; k < nodes.size(); ++k) {
+		REQUIRE(!nodes[k].cpus.empty());
+		cpus.insert(cpus.end(), nodes[k].cpus.begin(), nodes[k].cpus.end());
+	}
+
+	std::sort(cpus.begin(), cpus.end());
+
+	REQUIRE(std::unique(cpus.begin(), cpus.end()) == cpus.end());
+	REQUIRE(pinCurrentThread(-1) == false);
+}
+
+TEST_CASE("parallel value iteration matches value iteration","[valueIteration]"){
+
+	MDP myMDP = createChainMDP(50, 0.9);
+
+	vector<double> serial = myMDP.valueIteration(1e-8);
+	long serialBackups = myMDP.getBackupCount();
+
+	//more workers than CPUs, with uneven partitions of the sparse chain rows
+	myMDP.setThreadCount(3);
+
+	REQUIRE(norm_inf(myMDP.parallelValueIteration(1e-8) - serial) < 1e-12);
+	REQUIRE(myMDP.getBackupCount() == serialBackups);
+
+	myMDP.setNumaPlacement(false);
+	myMDP.setThreadCount(7);
+
+	REQUIRE(norm_inf(myMDP.parallelValueIteration(1e-8) - serial) < 1e-12);
+
+	//dense rows
+	MDP testMDP = createTestMDP();
+	testMDP.setThreadCount(2);
+
+	REQUIRE(norm_inf(testMDP.parallelValueIteration(1e-8) - testMDP.valueIteration(1e-8)) < 1e-12);
+}
+
+TEST_CASE("stolen chunks are each run exactly once","[parallel]"){
+
+	WorkerPool pool(std::vector<int>(4, -1));
+	StealingScheduler scheduler(4);
+
+	std::vector<std::atomic<int> > taken(40);
+
+	//the pool is reused across rounds, and worker 0 never takes its own chunks so the others must steal them all
+	for (long round = 0; round < 3; ++round) {
+
+		for (int c = 0; c < 40; ++c) {
+			taken[c] = 0;
+		}
+
+		scheduler.refill(0, round, 0, 40);
+
+		for (int t = 1; t < 4; ++t) {
+			scheduler.refill(t, round, 40, 40);
+		}
+
+		pool.run([&](int t) {
+
+			int c;
+
+			while (t != 0 && scheduler.next(t, round, c)) {
+				++taken[c];
+			}
+		});
+
+		for (int c = 0; c < 40; ++c) {
+			REQUIRE(taken[c] == 1);
+		}
+	}
+
+	REQUIRE(scheduler.stolen(1) + scheduler.stolen(2) + scheduler.stolen(3) == 120);
+}
+
+TEST_CASE("work stealing sweeps handle skewed successor counts","[valueIteration]"){
+
+	//a chain where every tenth state can jump anywhere
+	int n = 60;
+
+	matrix<double> left = zero_matrix<double>(n, n);
+	matrix<double> jump = zero_matrix<double>(n, n);
+
+	for (int i = 0; i < n; ++i) {
+
+		left(i, std::max(i - 1, 0)) = 1.0;
+
+		if (i % 10 == 0) {
+			for (int j = 0; j < n; ++j) {
+				jump(i, j) = 1.0 / n;
+			}
+		} else {
+			jump(i, std::min(i + 1, n - 1)) = 1.0;
+		}
+	}
+
+	std::map<int, matrix<double> > ps;
+	ps[0] = left;
+	ps[1] = jump;
+
+	matrix<double> reward = zero_matrix<double>(n, 2);
+	reward(n - 1, 0) = 1.0;
+	reward(25, 1) = 0.5;
+
+	MDP myMDP(ps, reward, 0.9);
+
+	vector<double> serial = myMDP.valueIteration(1e-8);
+
+	myMDP.setThreadCount(4);
+	myMDP.setChunkSize(5);
+
+	vector<double> parallel = myMDP.parallelValueIteration(1e-8);
+
+	REQUIRE(norm_inf(parallel - serial) < 1e-12);
+	REQUIRE(myMDP.getBackupCount() > 0);
+
+	matrix<double> greedy = myMDP.policyImprovement(parallel);
+	matrix<double> parallelGreedy = myMDP.parallelPolicyImprovement(parallel);
+
+	for (int i = 0; i < n; ++i) {
+		REQUIRE(greedy(i, 0) == parallelGreedy(i, 0));
+		REQUIRE(greedy(i, 1) == parallelGreedy(i, 1));
+	}
+
+	//the default chunking, on the pool left from the last solve
+	myMDP.setChunkSize(0);
+
+	REQUIRE(norm_inf(myMDP.parallelValueIteration(1e-8) - serial) < 1e-12);
+}
+
+TEST_CASE("multi-color Gauss-Seidel converges in fewer sweeps","[policyEvaluation]"){
+
+	MDP myMDP = createChainMDP(80, 0.95);
+
+	//a chain is red-black colored
+	std::vector<int> colors = myMDP.stateColoring();
+
+	REQUIRE(*std::max_element(colors.begin(), colors.end()) == 1);
+
+	for (int i = 1; i < 80; ++i) {
+		REQUIRE(colors[i] != colors[i - 1]);
+	}
+
+	//a random walk, so convergence is not limited by the goal's self loop
+	matrix<double> policy = scalar_matrix<double>(80, 2, 0.5);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	vector<double> jacobi = myMDP.policyEvaluation(policyTrans, policyRew, 1e-10);
+	long jacobiBackups = myMDP.getBackupCount();
+
+	myMDP.setThreadCount(3);
+	myMDP.setEvaluationScheme(MDP::COLORED);
+
+	REQUIRE(norm_inf(myMDP.policyEvaluation(policyTrans, policyRew, 1e-10) - jacobi) < 1e-7);
+	REQUIRE(myMDP.getBackupCount() < jacobiBackups);
+
+	//value iteration over the coloring of a ring, which has no absorbing end to hold back Gauss-Seidel
+	int n = 80;
+
+	matrix<double> left = zero_matrix<double>(n, n);
+	matrix<double> right = zero_matrix<double>(n, n);
+
+	for (int i = 0; i < n; ++i) {
+		left(i, (i + n - 1) % n) = 0.9;
+		left(i, i) = 0.1;
+		right(i, (i + 1) % n) = 0.9;
+		right(i, i) = 0.1;
+	}
+
+	std::map<int, matrix<double> > ps;
+	ps[0] = left;
+	ps[1] = right;
+
+	matrix<double> reward = zero_matrix<double>(n, 2);
+	reward(n - 1, 1) = 1.0;
+
+	MDP ring(ps, reward, 0.95);
+
+	vector<double> serial = ring.valueIteration(1e-10);
+	long serialBackups = ring.getBackupCount();
+
+	ring.setThreadCount(3);
+	ring.setEvaluationScheme(MDP::COLORED);
+
+	REQUIRE(norm_inf(ring.parallelValueIteration(1e-10) - serial) < 1e-7);
+	REQUIRE(ring.getBackupCount() < serialBackups);
+}
+
+TEST_CASE("asynchronous value iteration converges without barriers","[valueIteration]"){
+
+	MDP myMDP = createChainMDP(60, 0.9);
+
+	vector<double> serial = myMDP.valueIteration(1e-10);
+
+	//more workers than CPUs, so their passes interleave arbitrarily
+	myMDP.setThreadCount(4);
+
+	for (int run = 0; run < 3; ++run) {
+		REQUIRE(norm_inf(myMDP.asynchronousValueIteration(1e-10) - serial) < 1e-7);
+		REQUIRE(myMDP.getBackupCount() >= 60);
+	}
+
+	//dense rows, and more workers than chunks
+	MDP testMDP = createTestMDP();
+	testMDP.setThreadCount(5);
+
+	REQUIRE(norm_inf(testMDP.asynchronousValueIteration(1e-10) - testMDP.valueIteration(1e-10)) < 1e-7);
+}
+
+//dense MDP with pseudo-random transitions and rewards, for checking results bit for bit
+MDP createRandomMDP(int n, int actions, double discount) {
+
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	std::map<int, matrix<double> > ps;
+	matrix<double> reward(n, actions);
+
+	for (int a = 0; a < actions; ++a) {
+
+		matrix<double> p(n, n);
+
+		for (int i = 0; i < n; ++i) {
+
+			for (int j = 0; j < n; ++j) {
+				p(i, j) = uniform(generator);
+			}
+
+			row(p, i) /= sum(row(p, i));
+			reward(i, a) = uniform(generator);
+		}
+
+		ps[a] = p;
+	}
+
+	return MDP(ps, reward, discount);
+}
+
+TEST_CASE("multi-color Gauss-Seidel falls back to Jacobi on dense models","[policyEvaluation]"){
+
+	MDP myMDP = createRandomMDP(60, 3, 0.9);
+
+	//every state moves to every other, so each needs its own color
+	std::vector<int> colors = myMDP.stateColoring();
+
+	REQUIRE(*std::max_element(colors.begin(), colors.end()) == 59);
+
+	vector<double> serial = myMDP.valueIteration(1e-10);
+
+	matrix<double> policy = scalar_matrix<double>(60, 3, 1.0 / 3.0);
+	matrix<double> policyTrans = myMDP.policyTransitions(policy);
+	vector<double> policyRew = myMDP.policyReward(policy);
+
+	myMDP.setThreadCount(3);
+	myMDP.setEvaluationScheme(MDP::COLORED);
+
+	REQUIRE(norm_inf(myMDP.parallelValueIteration(1e-10) - serial) < 1e-8);
+	REQUIRE(norm_inf(myMDP.policyEvaluation(policyTrans, policyRew, 1e-10)
+			- myMDP.exactPolicyEvaluation(policyTrans, policyRew)) < 1e-8);
+}
+
+TEST_CASE("reproducible reductions are bit-identical across instruction sets","[kernels]"){
+
+	KernelInstructionSet widest = detectKernelInstructionSet();
+
+	for (int n = 0; n < 40; ++n) {
+
+		std::vector<double> a(n + 1), b(n + 1), ones(n + 1, 1.0);
+		std::vector<int> columns(n + 1);
+
+		for (int j = 0; j <= n; ++j) {
+			a[j] = std::sin(j + 1.0);
+			b[j] = std::cos(3.0 * j) * 1e3;
+			columns[j] = j;
+		}
+
+		double dense[3], sparse[3];
+
+		for (int isa = SCALAR_KERNELS; isa <= widest; ++isa) {
+
+			setKernelInstructionSet((KernelInstructionSet) isa);
+
+			dense[isa] = denseDot(&a[0], &b[0], n, true);
+			sparse[isa] = sparseDot(&a[0], &columns[0], n, &b[0], true);
+		}
+
+		for (int isa = SCALAR_KERNELS; isa <= widest; ++isa) {
+			REQUIRE(dense[isa] == dense[SCALAR_KERNELS]);
+			REQUIRE(sparse[isa] == dense[SCALAR_KERNELS]);
+		}
+
+		REQUIRE(treeSum(&a[0], n) == denseDot(&a[0], &ones[0], n, true));
+	}
+
+	//whole solves, whatever the instruction set and number of workers
+	MDP myMDP = createRandomMDP(45, 3, 0.9);
+	myMDP.setReproducibleReductions(true);
+
+	setKernelInstructionSet(SCALAR_KERNELS);
+	myMDP.setThreadCount(1);
+
+	vector<double> reference = myMDP.parallelValueIteration(1e-9);
+
+	//a model in the fast mode keeps solving alongside without changing the other's mode
+	MDP fastMDP = createRandomMDP(45, 3, 0.9);
+	fastMDP.setThreadCount(2);
+
+	vector<double> fastReference = fastMDP.parallelValueIteration(1e-9);
+	vector<double> fastValues;
+
+	for (int isa = SCALAR_KERNELS; isa <= widest; ++isa) {
+
+		setKernelInstructionSet((KernelInstructionSet) isa);
+
+		for (int threads = 1; threads <= 4; ++threads) {
+
+			myMDP.setThreadCount(threads);
+
+			std::thread fastSolve([&] {
+				fastValues = fastMDP.asynchronousValueIteration(1e-9);
+			});
+
+			vector<double> values = myMDP.asynchronousValueIteration(1e-9);
+
+			fastSolve.join();
+
+			for (int i = 0; i < 45; ++i) {
+				REQUIRE(values(i) == reference(i));
+			}
+
+			REQUIRE(norm_inf(fastValues - fastReference) < 1e-7);
+		}
+	}
+
+	//the serial solvers' fused dense backups follow the model's mode too, with the process default off
+	REQUIRE(!reproducibleReductions());
+
+	MDP denseMDP = createRandomMDP(101, 3, 0.9);
+	denseMDP.setReproducibleReductions(true);
+
+	setKernelInstructionSet(SCALAR_KERNELS);
+
+	vector<double> serialReference = denseMDP.valueIteration(1e-9);
+	matrix<double> policyReference = denseMDP.policyIteration();
+
+	for (int isa = SCALAR_KERNELS; isa <= widest; ++isa) {
+
+		setKernelInstructionSet((KernelInstructionSet) isa);
+
+		vector<double> values = denseMDP.valueIteration(1e-9);
+		matrix<double> policy = denseMDP.policyIteration();
+
+		for (int i = 0; i < 101; ++i) {
+			REQUIRE(values(i) == serialReference(i));
+		}
+
+		REQUIRE(norm_inf(policy - policyReference) == 0.0);
+		REQUIRE(norm_inf(denseMDP.policyImprovement(values) - policyReference)
+				== 0.0);
+	}
+
+	setKernelInstructionSet(widest);
+
+	//the process default only selects the mode of the kernels called without one
+	std::vector<double> a(21), b(21);
+
+	for (int j = 0; j < 21; ++j) {
+		a[j] = std::sin(j + 1.0);
+		b[j] = std::cos(3.0 * j) * 1e3;
+	}
+
+	setReproducibleReductions(true);
+
+	REQUIRE(denseDot(&a[0], &b[0], 21) == denseDot(&a[0], &b[0], 21, true));
+
+	setReproducibleReductions(false);
+
+	REQUIRE(!reproducibleReductions());
+	REQUIRE(kernelInstructionSet() == widest);
+}
+
+TEST_CASE("overhead of reproducible reductions","[.benchmark]"){
+
+	MDP myMDP = createRandomMDP(400, 4, 0.9);
+
+	//untimed solves start the workers and touch the rows in both modes first
+	for (int reproducible = 0; reproducible <= 1; ++reproducible) {
+		myMDP.setReproducibleReductions(reproducible);
+		myMDP.parallelValueIteration(1e-6);
+	}
+
+	//the modes alternate, and the fastest of the runs of each is reported
+	double best[2] = { std::numeric_limits<double>::infinity(),
+			std::numeric_limits<double>::infinity() };
+	long backups[2];
+
+	for (int run = 0; run < 5; ++run) {
+
+		for (int reproducible = 0; reproducible <= 1; ++reproducible) {
+
+			myMDP.setReproducibleReductions(reproducible);
+
+			std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+
+			myMDP.parallelValueIteration(1e-6);
+
+			double seconds = std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - start).count();
+
+			best[reproducible] = std::min(best[reproducible], seconds);
+			backups[reproducible] = myMDP.getBackupCount();
+		}
+	}
+
+	for (int reproducible = 0; reproducible <= 1; ++reproducible) {
+		WARN((reproducible ? "reproducible: " : "fast: ")
+				<< best[reproducible] << " s per solve, "
+				<< backups[reproducible] << " backups");
+	}
+}